@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include "bench.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+static volatile float bench_sink_f;
+static const void* volatile bench_sink_p;
+
+void bench_consume(float v) { bench_sink_f = v; }
+void bench_consume(const void* p) { bench_sink_p = p; }
+
+long long peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return (long long)pmc.PeakWorkingSetSize;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return (long long)ru.ru_maxrss;
+#else
+    return (long long)ru.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+BenchSuite::BenchSuite() : min_time_(0.5), filter_(), results_() {
+}
+
+void BenchSuite::set_min_time(double seconds) { min_time_ = seconds; }
+void BenchSuite::set_filter(const std::string& filter) { filter_ = filter; }
+
+bool BenchSuite::selected(const std::string& name) const {
+    return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+void BenchSuite::run(const std::string& name, const std::string& params, long long ops,
+    const std::function<void()>& setup, const std::function<void()>& body)
+{
+    if (!selected(name)) return;
+    typedef std::chrono::steady_clock clock;
+
+    const int min_samples = 5, max_samples = 1000;
+    std::vector<double> samples;
+    double total = 0.0;
+    for (int i = -1; i < max_samples; i++) {
+        if (setup) setup();
+        clock::time_point t0 = clock::now();
+        body();
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+        if (i < 0) continue;
+        samples.push_back(ns);
+        total += ns;
+        if ((int)samples.size() >= min_samples && total >= min_time_ * 1e9) break;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    BenchResult r;
+    r.name = name;
+    r.params = params;
+    r.ops = std::max(1LL, ops);
+    r.samples = (int)samples.size();
+    r.min_ns = samples.front() / r.ops;
+    r.median_ns = samples[samples.size() / 2] / r.ops;
+    r.mean_ns = total / samples.size() / r.ops;
+    results_.push_back(r);
+
+    std::cout << name << " [" << params << "]: " << r.median_ns << " ns/op (min " << r.min_ns
+        << ", " << r.samples << " samples)" << std::endl;
+}
+
+void BenchSuite::run(const std::string& name, const std::string& params, long long ops,
+    const std::function<void()>& body)
+{
+    run(name, params, ops, std::function<void()>(), body);
+}
+
+const std::vector<BenchResult>& BenchSuite::results() const { return results_; }
+
+bool BenchSuite::write_json(const char* path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot open file: " << path << std::endl;
+        return false;
+    }
+    out << "{\"benchmarks\": [\n";
+    for (size_t i = 0; i < results_.size(); i++) {
+        const BenchResult& r = results_[i];
+        out << "{\"name\": \"" << r.name << "\", \"params\": \"" << r.params << "\", \"ops\": " << r.ops
+            << ", \"samples\": " << r.samples << ", \"min_ns\": " << r.min_ns
+            << ", \"median_ns\": " << r.median_ns << ", \"mean_ns\": " << r.mean_ns << "}"
+            << (i + 1 < results_.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return (bool)out;
+}
+
+// Reads the "key": value pairs this writer emits; not a general JSON parser.
+static bool json_field(const std::string& line, const char* key, std::string& value) {
+    std::string k = std::string("\"") + key + "\": ";
+    size_t p = line.find(k);
+    if (p == std::string::npos) return false;
+    p += k.size();
+    if (line[p] == '"') {
+        size_t e = line.find('"', p + 1);
+        if (e == std::string::npos) return false;
+        value = line.substr(p + 1, e - p - 1);
+        return true;
+    }
+    size_t e = line.find_first_of(",}", p);
+    value = line.substr(p, e == std::string::npos ? std::string::npos : e - p);
+    return true;
+}
+
+int BenchSuite::compare(const char* baseline_path, double tolerance) const {
+    std::ifstream in(baseline_path);
+    if (!in) {
+        std::cerr << "Cannot open file: " << baseline_path << std::endl;
+        return -1;
+    }
+
+    std::map<std::string, double> base;
+    std::string line, name, params, best;
+    while (std::getline(in, line)) {
+        if (json_field(line, "name", name) && json_field(line, "params", params) && json_field(line, "min_ns", best)) {
+            base[name + " [" + params + "]"] = std::strtod(best.c_str(), nullptr);
+        }
+    }
+
+    int regressions = 0;
+    for (const BenchResult& r : results_) {
+        auto it = base.find(r.name + " [" + r.params + "]");
+        if (it == base.end() || it->second <= 0.0) continue;
+        double ratio = r.min_ns / it->second;
+        if (ratio > 1.0 + tolerance) {
+            std::cout << "REGRESSION " << it->first << ": " << it->second << " -> " << r.min_ns
+                << " ns/op (x" << ratio << ")" << std::endl;
+            regressions++;
+        }
+    }
+    return regressions;
+}
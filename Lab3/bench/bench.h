@@ -0,0 +1,62 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// One measured case. Times are per operation, over the timed samples.
+struct BenchResult {
+    std::string name;
+    std::string params;
+    long long ops;          // operations per sample
+    int samples;
+    double min_ns;
+    double median_ns;
+    double mean_ns;
+};
+
+// Minimal timing harness: each case is sampled until it has run for the
+// minimum time (and at least a few samples), after one warm-up sample.
+// Results are written as JSON, one case per line, and can be compared with
+// an earlier run to catch regressions.
+class BenchSuite {
+public:
+    BenchSuite();
+
+    void set_min_time(double seconds);
+    // Only cases whose name contains filter are run.
+    void set_filter(const std::string& filter);
+    bool selected(const std::string& name) const;
+
+    // setup runs before every sample and is not timed; body is timed and
+    // performs ops operations.
+    void run(const std::string& name, const std::string& params, long long ops,
+        const std::function<void()>& setup, const std::function<void()>& body);
+    void run(const std::string& name, const std::string& params, long long ops,
+        const std::function<void()>& body);
+
+    const std::vector<BenchResult>& results() const;
+    bool write_json(const char* path) const;
+
+    // Number of cases whose fastest sample is more than tolerance (0.1 =
+    // 10%) slower than in the baseline file; the minimum is far less noisy
+    // than the median on a busy machine. Cases missing from either side are
+    // skipped.
+    int compare(const char* baseline_path, double tolerance) const;
+
+private:
+    double min_time_;
+    std::string filter_;
+    std::vector<BenchResult> results_;
+};
+
+// Highest resident set size of this process so far, in bytes; 0 where the
+// platform does not tell.
+long long peak_rss_bytes();
+
+// Keeps the compiler from dropping a computation whose result is unused.
+void bench_consume(float v);
+void bench_consume(const void* p);
+
+#endif
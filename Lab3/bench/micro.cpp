@@ -0,0 +1,350 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "synth.h"
+#include "graphics.h"
+#include "model.h"
+#include "profiler.h"
+#include "render_context.h"
+#include "shade_simd.h"
+#include "tiler.h"
+
+// Microbenchmarks for the Lab3 hot paths, on generated inputs.
+//
+//   lab3_bench [--tris 10000,100000] [--res 512,1024] [--filter name]
+//              [--min-time seconds] [--dir path] [--out results.json]
+//              [--baseline old.json] [--tolerance 0.1] [--simd scalar|sse4|avx2]
+//
+// --tris sweeps the mesh size of the OBJ load and normal benchmarks, --res
+// the target and image size of the raster and TGA ones. With --baseline the
+// exit status is 1 when any case got slower than the tolerance allows.
+
+static std::string param(const char* key, long long v) {
+    std::ostringstream s;
+    s << key << "=" << v;
+    return s.str();
+}
+
+static void bench_math(BenchSuite& suite) {
+    const int n = 1024;
+    SynthRandom rng(7);
+    std::vector<Matrix> ms(n);
+    std::vector<Mat4f> fs(n);
+    for (int i = 0; i < n; i++) {
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) ms[i][r][c] = rng.uniform(-1.f, 1.f) + (r == c ? 4.f : 0.f);
+        }
+        fs[i] = ms[i].to_mat4();
+    }
+
+    suite.run("matrix_mul", "", n, [&]() {
+        Matrix acc = Matrix::identity(4);
+        for (int i = 0; i < n; i++) acc = ms[i] * ms[(i + 1) % n];
+        bench_consume(acc[0][0]);
+    });
+    suite.run("matrix_inverse", "", n, [&]() {
+        float s = 0.f;
+        for (int i = 0; i < n; i++) s += ms[i].inverse()[0][0];
+        bench_consume(s);
+    });
+    suite.run("mat4f_mul", "", n, [&]() {
+        float s = 0.f;
+        for (int i = 0; i < n; i++) s += (fs[i] * fs[(i + 1) % n])[0][0];
+        bench_consume(s);
+    });
+    suite.run("mat4f_inverse", "", n, [&]() {
+        float s = 0.f;
+        for (int i = 0; i < n; i++) s += inverse(fs[i])[0][0];
+        bench_consume(s);
+    });
+}
+
+static void bench_shading(BenchSuite& suite) {
+    const int n = 4096;
+    SynthRandom rng(11);
+    Vec3f tri[3] = { Vec3f(10.f, 10.f, 0.f), Vec3f(500.f, 40.f, 0.f), Vec3f(200.f, 480.f, 0.f) };
+    std::vector<Vec2i> ps(n);
+    std::vector<Vec3f> bcs(n);
+    for (int i = 0; i < n; i++) {
+        ps[i] = Vec2i((int)rng.uniform(0.f, 512.f), (int)rng.uniform(0.f, 512.f));
+        float a = rng.uniform(0.f, 1.f), b = rng.uniform(0.f, 1.f - a);
+        bcs[i] = Vec3f(a, b, 1.f - a - b);
+    }
+
+    suite.run("barycentric", "", n, [&]() {
+        float s = 0.f;
+        for (int i = 0; i < n; i++) s += barycentric(tri, ps[i]).x;
+        bench_consume(s);
+    });
+
+    // phongColor() is internal to graphics.cpp; shade_phong_flat() is the
+    // thinnest public way in (normal and position interpolation on top).
+    Vec3f norms[3] = { Vec3f(0.f, 0.f, 1.f), Vec3f(0.f, 0.6f, 0.8f), Vec3f(0.6f, 0.f, 0.8f) };
+    Vec3f light(0.f, 0.f, -1.f), eye(1.f, 0.f, 4.f);
+    TGAColor albedo(200, 150, 100, 255);
+    suite.run("shade_phong_flat", "", n, [&]() {
+        float s = 0.f;
+        for (int i = 0; i < n; i++) s += shade_phong_flat(bcs[i], norms, tri, light, eye, albedo).r;
+        bench_consume(s);
+    });
+}
+
+static void bench_triangles(BenchSuite& suite, int res) {
+    RenderTarget target;
+    target.resize(res, res);
+    target.set_use_hiz(false);
+
+    TGAImage diffuse = make_test_image(1024, 1024, TGAImage::RGB, 0.5f);
+    RenderContext ctx;
+    ctx.target = &target;
+    ctx.diffuse = &diffuse;
+
+    std::vector<int> ids((size_t)res * res, -1);
+    std::vector<Vec3f> bary((size_t)res * res);
+
+    const TriangleSize sizes[3] = { TRI_SMALL, TRI_MEDIUM, TRI_SCREEN };
+    for (TriangleSize size : sizes) {
+        int n = size == TRI_SMALL ? 4096 : size == TRI_MEDIUM ? 256 : 4;
+        SynthRandom rng(3);
+        std::vector<Vec3f> pts;
+        make_triangles(rng, n, size, res, res, pts);
+
+        Vec2f uvs[3] = { Vec2f(0.1f, 0.1f), Vec2f(0.9f, 0.2f), Vec2f(0.3f, 0.8f) };
+        Vec3f norms[3] = { Vec3f(0.f, 0.f, 1.f), Vec3f(0.f, 0.6f, 0.8f), Vec3f(0.6f, 0.f, 0.8f) };
+        Vec3f world[3] = { Vec3f(-1.f, -1.f, 0.f), Vec3f(1.f, -1.f, 0.f), Vec3f(-1.f, 1.f, 0.f) };
+        Vec3f light(0.f, 0.f, -1.f), eye(1.f, 0.f, 4.f);
+        TGAColor color(180, 180, 180, 255);
+
+        std::string p = param("res", res) + " size=" + triangle_size_name(size);
+        auto clear = [&]() { target.clear(); };
+
+        suite.run("triangle_flat", p, n, clear, [&]() {
+            for (int i = 0; i < n; i++) triangle_flat(ctx, &pts[i * 3], color);
+        });
+        suite.run("triangle_phong_flat", p, n, clear, [&]() {
+            for (int i = 0; i < n; i++) triangle_phong_flat(ctx, &pts[i * 3], norms, world, light, eye, color);
+        });
+        suite.run("triangle_phong_tex", p, n, clear, [&]() {
+            for (int i = 0; i < n; i++) triangle_phong_tex(ctx, &pts[i * 3], uvs, norms, world, light, eye);
+        });
+        suite.run("triangle_alpha", p, n, clear, [&]() {
+            for (int i = 0; i < n; i++) triangle_alpha(ctx, &pts[i * 3], color, 0.15f);
+        });
+        suite.run("triangle_visibility", p, n, clear, [&]() {
+            for (int i = 0; i < n; i++) triangle_visibility(ctx, &pts[i * 3], i, ids.data(), bary.data());
+        });
+    }
+}
+
+// Small triangles behind a full-screen occluder: with HiZ on, nearly all
+// of them should be rejected whole, before any block is tested.
+static void bench_occluded(BenchSuite& suite, int res) {
+    if (!suite.selected("triangle_occluded")) return;
+
+    RenderTarget target;
+    target.resize(res, res);
+    RenderContext ctx;
+    ctx.target = &target;
+
+    const int n = 4096;
+    SynthRandom rng(5);
+    std::vector<Vec3f> occluder, pts;
+    make_triangles(rng, 1, TRI_SCREEN, res, res, occluder);
+    make_triangles(rng, n, TRI_SMALL, res, res, pts);
+    for (Vec3f& v : pts) v.z *= 0.5f;
+    TGAColor color(180, 180, 180, 255);
+
+    auto setup = [&]() {
+        target.clear();
+        triangle_flat(ctx, occluder.data(), color);
+    };
+    for (int hiz = 0; hiz < 2; hiz++) {
+        target.set_use_hiz(hiz != 0);
+        suite.run("triangle_occluded", param("res", res) + param(" hiz", hiz), n, setup, [&]() {
+            for (int i = 0; i < n; i++) triangle_flat(ctx, &pts[i * 3], color);
+        });
+    }
+
+    setup();
+    const HiZBuffer* h = target.hiz();
+    long long culled = h->triangles_culled;
+    for (int i = 0; i < n; i++) triangle_flat(ctx, &pts[i * 3], color);
+    std::cout << "  hiz culled " << h->triangles_culled - culled << "/" << n << " occluded triangles" << std::endl;
+}
+
+// Two overlapping layers of triangles, far one first, through the tiler
+// in deferred mode with batches much smaller than the mesh. Batching must
+// not cost extra shading: each covered pixel is shaded exactly once. False
+// when it is not.
+static bool bench_deferred(BenchSuite& suite, int res) {
+    if (!suite.selected("tiles_deferred")) return true;
+
+    RenderTarget target;
+    target.resize(res, res);
+    RenderContext ctx;
+    ctx.target = &target;
+
+    const int n = 4096, batch = 1024;
+    SynthRandom rng(7);
+    std::vector<Vec3f> near_pts, far_pts;
+    make_triangles(rng, n, TRI_SMALL, res, res, near_pts);
+    far_pts = near_pts;
+    for (Vec3f& v : far_pts) v.z *= 0.5f;
+
+    Vec3f norms[3] = { Vec3f(0.f, 0.f, 1.f), Vec3f(0.f, 0.6f, 0.8f), Vec3f(0.6f, 0.f, 0.8f) };
+    Vec3f world[3] = { Vec3f(-1.f, -1.f, 0.f), Vec3f(1.f, -1.f, 0.f), Vec3f(-1.f, 1.f, 0.f) };
+    Vec3f light(0.f, 0.f, -1.f), eye(1.f, 0.f, 4.f);
+
+    TileRenderer tiler(res, res, 64, batch);
+    tiler.set_deferred(true);
+    auto draw = [&]() {
+        for (const std::vector<Vec3f>* layer : { &far_pts, &near_pts }) {
+            for (int i = 0; i < n; i++) {
+                BinnedTriangle t;
+                for (int k = 0; k < 3; k++) {
+                    t.pts[k] = (*layer)[i * 3 + k];
+                    t.norms[k] = norms[k];
+                    t.world[k] = world[k];
+                }
+                t.color = TGAColor(180, 180, 180, 255);
+                t.alpha = 1.f;
+                t.kind = TRI_PHONG_FLAT;
+                tiler.submit(t);
+                if (tiler.full()) tiler.flush(ctx, light, eye, 1);
+            }
+        }
+        tiler.render(ctx, light, eye, 1);
+    };
+    auto clear = [&]() {
+        target.clear();
+        tiler.clear();
+    };
+    suite.run("tiles_deferred", param("res", res) + param(" batch", batch), 2 * n, clear, draw);
+
+    set_profiling(true);
+    if (!profiling()) return true;
+    clear();
+    draw();
+    long long shaded = profile_counter(PROF_FRAGMENTS_SHADED);
+    set_profiling(false);
+
+    const float* zb = target.depth();
+    long long covered = 0;
+    for (int i = 0; i < res * res; i++) covered += zb[i] != -std::numeric_limits<float>::infinity();
+    std::cout << "  deferred shaded " << shaded << " fragments for " << covered << " covered pixels" << std::endl;
+    if (shaded == covered) return true;
+    std::cerr << "deferred shading overdraw across batches\n";
+    return false;
+}
+
+static void bench_mesh(BenchSuite& suite, const std::string& dir, long long tris) {
+    if (!suite.selected("model_load") && !suite.selected("vertex_normals")) return;
+
+    std::string path = dir + "/bench_sphere_" + std::to_string(tris) + ".obj";
+    if (!write_sphere_obj(path.c_str(), tris)) return;
+    std::string p = param("tris", sphere_triangles(tris));
+
+    // No mesh cache: this times the parse itself.
+    suite.run("model_load", p, 1, [&]() {
+        Model m(path.c_str(), 0, false);
+        bench_consume(&m);
+    });
+
+    Model m(path.c_str(), 0, false);
+    suite.run("vertex_normals_area", p, 1, [&]() { m.recompute_normals(NORMALS_AREA); });
+    suite.run("vertex_normals_angle", p, 1, [&]() { m.recompute_normals(NORMALS_ANGLE); });
+    std::remove(path.c_str());
+}
+
+static void bench_tga(BenchSuite& suite, const std::string& dir, int res) {
+    std::string path = dir + "/bench_image.tga";
+    std::string p = param("res", res);
+
+    // Blocky images compress well, noisy ones barely at all.
+    const float noises[2] = { 0.f, 1.f };
+    for (float noise : noises) {
+        TGAImage img = make_test_image(res, res, TGAImage::RGB, noise);
+        std::string pn = p + (noise > 0.f ? " content=noise" : " content=blocks");
+        for (int rle = 0; rle < 2; rle++) {
+            std::string pr = pn + (rle ? " rle=1" : " rle=0");
+            suite.run("tga_write", pr, 1, [&]() { img.write_tga_file(path.c_str(), rle != 0); });
+            if (!suite.selected("tga_read")) continue;
+            img.write_tga_file(path.c_str(), rle != 0);
+            suite.run("tga_read", pr, 1, [&]() {
+                TGAImage in;
+                in.read_tga_file(path.c_str());
+                bench_consume(in.buffer());
+            });
+        }
+    }
+    std::remove(path.c_str());
+
+    TGAImage img = make_test_image(res, res, TGAImage::RGB, 0.5f);
+    suite.run("flip_vertically", p, 1, [&]() { img.flip_vertically(); });
+    TGAImage scaled;
+    suite.run("scale_half", p, 1, [&]() { scaled = img; }, [&]() { scaled.scale(res / 2, res / 2); });
+}
+
+int main(int argc, char** argv) {
+    BenchSuite suite;
+    std::vector<long long> tris(1, 100000), res(1, 1024);
+    std::string dir = ".";
+    const char* out = "bench_results.json";
+    const char* baseline = nullptr;
+    double tolerance = 0.1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tris") && i + 1 < argc) tris = parse_list(argv[++i]);
+        else if (!strcmp(argv[i], "--res") && i + 1 < argc) res = parse_list(argv[++i]);
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc) suite.set_filter(argv[++i]);
+        else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) suite.set_min_time(std::atof(argv[++i]));
+        else if (!strcmp(argv[i], "--dir") && i + 1 < argc) dir = argv[++i];
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) baseline = argv[++i];
+        else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) tolerance = std::atof(argv[++i]);
+        else if (!strcmp(argv[i], "--simd") && i + 1 < argc) {
+            const char* level = argv[++i];
+            if (!strcmp(level, "scalar")) set_simd_level(SIMD_SCALAR);
+            else if (!strcmp(level, "sse4")) set_simd_level(SIMD_SSE4);
+            else if (!strcmp(level, "avx2")) set_simd_level(SIMD_AVX2);
+            else {
+                std::cerr << "Unknown --simd level " << level << " (scalar, sse4 or avx2)\n";
+                return 2;
+            }
+        }
+        else {
+            std::cerr << "Unknown argument " << argv[i] << "\n";
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    bench_math(suite);
+    bench_shading(suite);
+    for (long long r : res) {
+        if (r < 16) continue;
+        bench_triangles(suite, (int)r);
+        bench_occluded(suite, (int)r);
+        if (!bench_deferred(suite, (int)r)) ok = false;
+        bench_tga(suite, dir, (int)r);
+    }
+    for (long long t : tris) bench_mesh(suite, dir, t);
+
+    if (!suite.write_json(out) || !ok) return 1;
+    if (baseline) {
+        int regressions = suite.compare(baseline, tolerance);
+        if (regressions < 0) return 1;
+        if (regressions > 0) {
+            std::cout << regressions << " regression(s) over " << tolerance * 100.0 << "%\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "synth.h"
+#include "mapped_file.h"
+#include "model.h"
+#include "profiler.h"
+#include "renderer.h"
+
+// End-to-end scaling matrix: whole frames of real scenes over resolution
+// and thread count.
+//
+//   lab3_scaling [--head obj/african_head.obj] [--no-head]
+//                [--tris 10000,100000,1000000,10000000,50000000]
+//                [--res 512,1024,2048,4096,8192] [--threads 1,2,4,...]
+//                [--frames 3] [--dir path] [--out scaling.json]
+//                [--deferred] [--no-hiz] [--in-process]
+//
+// Scenes are the head model and UV spheres of each --tris size, all with
+// the glass cube on top. Spheres are generated into --dir on first use and
+// kept, with their mesh caches, for later runs. The default thread list is
+// the powers of two below the core count, plus all cores.
+//
+// Per point: median frame time over --frames frames (after one warm-up,
+// output write excluded), triangles submitted per second, shaded pixels
+// per second, peak RSS, and parallel efficiency against the smallest
+// thread count, t0 * T(t0) / (t * T(t)). Shaded pixels come from one
+// profiled frame per scene and resolution; they do not depend on the
+// thread count.
+//
+// Each scene and resolution runs in a child process of its own (this
+// program again, with --point-*), so its peak RSS is what loading that
+// scene and rendering at that resolution take, and nothing before it.
+// --in-process runs everything in one process instead; the RSS column is
+// then the high-water mark so far.
+
+struct ScalingPoint {
+    std::string scene;
+    long long triangles;
+    int res;
+    int threads;
+    double frame_ms;
+    long long shaded;
+    long long peak_rss;
+    double efficiency;
+};
+
+static std::vector<long long> default_threads() {
+    long long cores = default_thread_count();
+    std::vector<long long> t;
+    for (long long n = 1; n < cores; n *= 2) t.push_back(n);
+    t.push_back(cores);
+    return t;
+}
+
+static double render_ms(FrameRenderer& renderer, Model& m, const RenderJob& job) {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point t0 = clock::now();
+    renderer.render(m, job);
+    return std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+}
+
+static void run_scene(const std::string& scene, Model& m, const std::vector<long long>& res,
+    const std::vector<long long>& threads, int frames, const RenderOptions& base, std::vector<ScalingPoint>& out)
+{
+    for (long long r : res) {
+        RenderJob job;
+        job.output_path.clear();
+        job.width = job.height = (int)r;
+
+        FrameRenderer renderer;
+        RenderOptions options = base;
+        renderer.set_options(options);
+
+        set_profiling(true);
+        renderer.render(m, job);
+        long long shaded = profile_counter(PROF_FRAGMENTS_SHADED);
+        set_profiling(false);
+        long long triangles = renderer.primitive_stats().submitted;
+
+        double base_cost = 0.0;
+        for (long long t : threads) {
+            options.nthreads = (int)t;
+            renderer.set_options(options);
+            render_ms(renderer, m, job);
+
+            std::vector<double> times;
+            for (int f = 0; f < frames; f++) times.push_back(render_ms(renderer, m, job));
+            std::sort(times.begin(), times.end());
+
+            ScalingPoint p;
+            p.scene = scene;
+            p.triangles = triangles;
+            p.res = (int)r;
+            p.threads = (int)t;
+            p.frame_ms = times[times.size() / 2];
+            p.shaded = shaded;
+            p.peak_rss = peak_rss_bytes();
+            if (base_cost == 0.0) base_cost = p.frame_ms * t;
+            p.efficiency = base_cost / (p.frame_ms * t);
+            out.push_back(p);
+
+            std::cout << scene << " " << r << "x" << r << " threads " << t << ": " << p.frame_ms << " ms, "
+                << triangles / p.frame_ms * 1e-3 << " Mtri/s, " << shaded / p.frame_ms * 1e-3 << " Mpix/s, "
+                << p.peak_rss / (1024 * 1024) << " MB peak, efficiency " << p.efficiency << std::endl;
+        }
+    }
+}
+
+static bool write_points(const char* path, const std::vector<ScalingPoint>& points) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot open file: " << path << std::endl;
+        return false;
+    }
+    out << "{\"cores\": " << default_thread_count() << ", \"points\": [\n";
+    for (size_t i = 0; i < points.size(); i++) {
+        const ScalingPoint& p = points[i];
+        double s = p.frame_ms * 1e-3;
+        out << "{\"scene\": \"" << p.scene << "\", \"triangles\": " << p.triangles
+            << ", \"width\": " << p.res << ", \"height\": " << p.res << ", \"threads\": " << p.threads
+            << ", \"frame_ms\": " << p.frame_ms << ", \"triangles_per_s\": " << p.triangles / s
+            << ", \"shaded_pixels\": " << p.shaded << ", \"shaded_pixels_per_s\": " << p.shaded / s
+            << ", \"peak_rss_bytes\": " << p.peak_rss << ", \"efficiency\": " << p.efficiency << "}"
+            << (i + 1 < points.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return (bool)out;
+}
+
+// Child side: one line per point, read back by read_points().
+static bool write_point_lines(const char* path, const std::vector<ScalingPoint>& points) {
+    std::ofstream out(path);
+    for (const ScalingPoint& p : points) {
+        out << p.threads << " " << p.triangles << " " << p.frame_ms << " " << p.shaded << " "
+            << p.peak_rss << " " << p.efficiency << "\n";
+    }
+    return (bool)out;
+}
+
+static bool read_points(const char* path, const std::string& scene, int res, std::vector<ScalingPoint>& out) {
+    std::ifstream in(path);
+    ScalingPoint p;
+    p.scene = scene;
+    p.res = res;
+    size_t n = out.size();
+    while (in >> p.threads >> p.triangles >> p.frame_ms >> p.shaded >> p.peak_rss >> p.efficiency) out.push_back(p);
+    return out.size() > n;
+}
+
+static std::string quote(const std::string& s) {
+    return "\"" + s + "\"";
+}
+
+static std::string join(const std::vector<long long>& v) {
+    std::ostringstream s;
+    for (size_t i = 0; i < v.size(); i++) s << (i ? "," : "") << v[i];
+    return s.str();
+}
+
+// Runs one scene at one resolution in a fresh process.
+static bool run_point(const char* self, const std::string& scene, const std::string& obj, bool use_cache, long long res,
+    const std::vector<long long>& threads, int frames, const RenderOptions& options, std::vector<ScalingPoint>& out)
+{
+    std::ostringstream tmp;
+    tmp << "scaling_point_" << scene << "_" << res << ".txt";
+    std::string tmp_path = tmp.str();
+
+    std::ostringstream cmd;
+    cmd << quote(self) << " --point-scene " << scene << " --point-obj " << quote(obj) << " --point-out " << quote(tmp_path)
+        << (use_cache ? " --point-cache" : "")
+        << " --res " << res << " --threads " << join(threads) << " --frames " << frames
+        << (options.deferred ? " --deferred" : "") << (options.use_hiz ? "" : " --no-hiz");
+    std::string command = cmd.str();
+#ifdef _WIN32
+    // cmd.exe strips the first and last quote of the line.
+    command = "\"" + command + "\"";
+#endif
+    std::cout.flush();
+    int status = std::system(command.c_str());
+    bool ok = status == 0 && read_points(tmp_path.c_str(), scene, (int)res, out);
+    std::remove(tmp_path.c_str());
+    if (!ok) std::cerr << "Point " << scene << " " << res << " failed\n";
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    std::string head = "obj/african_head.obj";
+    std::vector<long long> tris = { 10000, 100000, 1000000, 10000000, 50000000 };
+    std::vector<long long> res = { 512, 1024, 2048, 4096, 8192 };
+    std::vector<long long> threads = default_threads();
+    int frames = 3;
+    std::string dir = ".";
+    const char* out = "scaling.json";
+    RenderOptions options;
+    bool in_process = false;
+    std::string point_scene, point_obj;
+    const char* point_out = nullptr;
+    bool point_cache = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--head") && i + 1 < argc) head = argv[++i];
+        else if (!strcmp(argv[i], "--no-head")) head.clear();
+        else if (!strcmp(argv[i], "--tris") && i + 1 < argc) tris = parse_list(argv[++i]);
+        else if (!strcmp(argv[i], "--res") && i + 1 < argc) res = parse_list(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = parse_list(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = std::max(1, std::atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--dir") && i + 1 < argc) dir = argv[++i];
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+        else if (!strcmp(argv[i], "--deferred")) options.deferred = true;
+        else if (!strcmp(argv[i], "--no-hiz")) options.use_hiz = false;
+        else if (!strcmp(argv[i], "--in-process")) in_process = true;
+        else if (!strcmp(argv[i], "--point-scene") && i + 1 < argc) point_scene = argv[++i];
+        else if (!strcmp(argv[i], "--point-obj") && i + 1 < argc) point_obj = argv[++i];
+        else if (!strcmp(argv[i], "--point-out") && i + 1 < argc) point_out = argv[++i];
+        else if (!strcmp(argv[i], "--point-cache")) point_cache = true;
+        else {
+            std::cerr << "Unknown argument " << argv[i] << "\n";
+            return 2;
+        }
+    }
+
+    std::sort(tris.begin(), tris.end());
+    std::sort(res.begin(), res.end());
+    res.erase(std::remove_if(res.begin(), res.end(), [](long long r) { return r < 16; }), res.end());
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::remove_if(threads.begin(), threads.end(), [](long long t) { return t < 1; }), threads.end());
+    if (res.empty() || threads.empty()) {
+        std::cerr << "Nothing to run\n";
+        return 2;
+    }
+
+    std::vector<ScalingPoint> points;
+    if (point_out) {
+        Model m(point_obj.c_str(), 0, point_cache);
+        if (m.nfaces() == 0) return 1;
+        run_scene(point_scene, m, res, threads, frames, options, points);
+        return write_point_lines(point_out, points) ? 0 : 1;
+    }
+
+    auto run = [&](const std::string& scene, const std::string& obj, bool use_cache) {
+        if (!in_process) {
+            for (long long r : res) run_point(argv[0], scene, obj, use_cache, r, threads, frames, options, points);
+            return;
+        }
+        Model m(obj.c_str(), 0, use_cache);
+        if (m.nfaces() > 0) run_scene(scene, m, res, threads, frames, options, points);
+    };
+
+    if (!head.empty()) run("head", head, false);
+
+    for (long long t : tris) {
+        std::string name = "bench_sphere_" + std::to_string(t);
+        std::string path = dir + "/" + name + ".obj";
+        if (file_mtime(path) < 0) {
+            std::cout << "generating " << path << std::endl;
+            if (!write_sphere_obj(path.c_str(), t)) return 1;
+        }
+        std::string diffuse = dir + "/" + name + "_diffuse.tga";
+        if (file_mtime(diffuse) < 0) make_test_image(1024, 1024, TGAImage::RGB, 0.f).write_tga_file(diffuse.c_str());
+
+        // Builds the mesh cache up front, so every point maps it and none
+        // pays for the parse.
+        if (!in_process) {
+            Model m(path.c_str(), 0, true);
+            if (m.nfaces() == 0) return 1;
+        }
+        std::ostringstream scene;
+        scene << "sphere" << sphere_triangles(t);
+        run(scene.str(), path, true);
+    }
+
+    return write_points(out, points) ? 0 : 1;
+}
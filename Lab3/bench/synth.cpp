@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "synth.h"
+
+SynthRandom::SynthRandom(unsigned long long seed) : s_(seed ? seed : 1) {
+}
+
+unsigned long long SynthRandom::next() {
+    s_ ^= s_ >> 12;
+    s_ ^= s_ << 25;
+    s_ ^= s_ >> 27;
+    return s_ * 0x2545F4914F6CDD1DULL;
+}
+
+float SynthRandom::uniform(float lo, float hi) {
+    return lo + (hi - lo) * (float)((next() >> 40) * (1.0 / 16777216.0));
+}
+
+// rings x 2 rings quads, minus one triangle per quad at each pole.
+static long long sphere_rings(long long ntris) {
+    long long rings = (long long)std::sqrt((double)std::max(ntris, 8LL) / 4.0);
+    return std::max(rings, 2LL);
+}
+
+long long sphere_triangles(long long ntris) {
+    long long rings = sphere_rings(ntris), segs = 2 * rings;
+    return 2 * rings * segs - 2 * segs;
+}
+
+bool write_sphere_obj(const char* path, long long ntris) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Cannot open file: " << path << std::endl;
+        return false;
+    }
+
+    // Lines are formatted into a buffer and written in large blocks.
+    std::string buf;
+    char line[128];
+    auto emit = [&](int n) {
+        buf.append(line, n);
+        if (buf.size() >= (1 << 20)) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    };
+
+    const double pi = 3.14159265358979323846;
+    long long rings = sphere_rings(ntris), segs = 2 * rings;
+
+    // (rings + 1) x (segs + 1) grid; the seam column is duplicated so the
+    // uvs wrap cleanly. Faces wind counter-clockwise seen from outside, like
+    // the bundled models.
+    for (long long i = 0; i <= rings; i++) {
+        double theta = pi * i / rings;
+        for (long long j = 0; j <= segs; j++) {
+            double phi = 2.0 * pi * j / segs;
+            emit(std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n",
+                std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+    for (long long i = 0; i <= rings; i++) {
+        for (long long j = 0; j <= segs; j++) {
+            emit(std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", (double)j / segs, 1.0 - (double)i / rings));
+        }
+    }
+
+    for (long long i = 0; i < rings; i++) {
+        for (long long j = 0; j < segs; j++) {
+            long long a = i * (segs + 1) + j + 1, b = a + 1;
+            long long c = a + segs + 1, d = c + 1;
+            if (i > 0) emit(std::snprintf(line, sizeof(line), "f %lld/%lld %lld/%lld %lld/%lld\n", a, a, b, b, c, c));
+            if (i + 1 < rings) emit(std::snprintf(line, sizeof(line), "f %lld/%lld %lld/%lld %lld/%lld\n", b, b, d, d, c, c));
+        }
+    }
+    out.write(buf.data(), buf.size());
+
+    if (!out) std::cerr << "Cannot write " << path << std::endl;
+    return (bool)out;
+}
+
+TGAImage make_test_image(int w, int h, int bpp, float noise, unsigned long long seed) {
+    TGAImage img(w, h, bpp);
+    SynthRandom rng(seed);
+    unsigned char* data = img.buffer();
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int bx = x / 16, by = y / 16;
+            unsigned char c[4] = {
+                (unsigned char)(bx * 7), (unsigned char)(by * 5), (unsigned char)((bx + by) * 3), 255
+            };
+            if (noise > 0.f && rng.uniform(0.f, 1.f) < noise) {
+                unsigned long long r = rng.next();
+                for (int k = 0; k < 3; k++) c[k] = (unsigned char)(r >> (8 * k));
+            }
+            for (int k = 0; k < bpp; k++) data[((size_t)y * w + x) * bpp + k] = c[k];
+        }
+    }
+    return img;
+}
+
+const char* triangle_size_name(TriangleSize size) {
+    switch (size) {
+    case TRI_SMALL: return "small";
+    case TRI_MEDIUM: return "medium";
+    default: return "screen";
+    }
+}
+
+void make_triangles(SynthRandom& rng, int n, TriangleSize size, int w, int h, std::vector<Vec3f>& pts) {
+    pts.resize((size_t)n * 3);
+    // Right triangles with legs r: area r^2 / 2.
+    float r = size == TRI_SMALL ? 5.7f : 63.f;
+    for (int i = 0; i < n; i++) {
+        float z = (float)(i + 1) / n;
+        Vec3f* p = &pts[(size_t)i * 3];
+        if (size == TRI_SCREEN) {
+            p[0] = Vec3f(-1.f, -1.f, z);
+            p[1] = Vec3f(2.f * w + 1.f, -1.f, z);
+            p[2] = Vec3f(-1.f, 2.f * h + 1.f, z);
+            continue;
+        }
+        float x = rng.uniform(0.f, w - r - 1.f), y = rng.uniform(0.f, h - r - 1.f);
+        p[0] = Vec3f(x, y, z);
+        p[1] = Vec3f(x + r, y, z);
+        p[2] = Vec3f(x, y + r, z);
+    }
+}
+
+std::vector<long long> parse_list(const std::string& s) {
+    std::vector<long long> out;
+    size_t p = 0;
+    while (p <= s.size()) {
+        size_t e = s.find(',', p);
+        if (e == std::string::npos) e = s.size();
+        if (e > p) out.push_back(std::atoll(s.substr(p, e - p).c_str()));
+        p = e + 1;
+    }
+    return out;
+}
@@ -0,0 +1,53 @@
+#ifndef __SYNTH_H__
+#define __SYNTH_H__
+
+#include <string>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+
+// Deterministic inputs for the benchmarks: the same seed gives the same
+// meshes, images and triangles on every machine and every run.
+
+// xorshift64*; small, fast and identical everywhere, unlike std::rand.
+class SynthRandom {
+public:
+    explicit SynthRandom(unsigned long long seed = 1);
+
+    unsigned long long next();
+    // Uniform in [lo, hi).
+    float uniform(float lo, float hi);
+
+private:
+    unsigned long long s_;
+};
+
+// UV sphere of radius 1 with close to ntris triangles, written as an OBJ
+// with v, vt and f a/a b/b c/c lines (normals are left to the loader).
+// Streams to disk, so tens of millions of triangles need no memory.
+bool write_sphere_obj(const char* path, long long ntris);
+// Triangle count write_sphere_obj() produces for a request of ntris.
+long long sphere_triangles(long long ntris);
+
+// w x h image: smooth gradients cut into flat 16x16 blocks, with noise
+// sprinkled over a fraction of the pixels. noise = 0 gives long runs (RLE
+// friendly), noise = 1 none at all.
+TGAImage make_test_image(int w, int h, int bpp, float noise, unsigned long long seed = 1);
+
+enum TriangleSize {
+    TRI_SMALL,    // about 16 pixels
+    TRI_MEDIUM,   // about 2000 pixels
+    TRI_SCREEN    // covers the whole screen
+};
+
+const char* triangle_size_name(TriangleSize size);
+
+// n screen-space triangles of the given size, three points each, placed at
+// random inside a w x h screen. Depth grows with the index, so each one
+// passes the depth test over everything drawn before it.
+void make_triangles(SynthRandom& rng, int n, TriangleSize size, int w, int h, std::vector<Vec3f>& pts);
+
+// Parses "a,b,c" into numbers; empty entries are skipped.
+std::vector<long long> parse_list(const std::string& s);
+
+#endif
@@ -0,0 +1,167 @@
+#include "clipper.h"
+#include "graphics.h"
+
+// Smallest w kept by the near plane; divides by anything closer to the
+// w = 0 plane would blow up.
+static const float near_w = 1e-3f;
+
+// Slack around the screen, in pixels, inside which triangles are left to the
+// rasterizer's bounding box instead of being clipped. It keeps the snapped
+// coordinates far inside the fixed-point range of setup_triangle.
+static const float guard_band = 16384.f;
+
+static const int max_clip_verts = 3 + 5;
+
+unsigned clip_outcode(const Vec4f& p, float width, float height) {
+    float x = p[0], y = p[1], w = p[3];
+    unsigned code = 0;
+    if (w < near_w) code |= CLIP_NEAR;
+    if (x < 0.f) code |= CLIP_LEFT;
+    if (x > width * w) code |= CLIP_RIGHT;
+    if (y < 0.f) code |= CLIP_BOTTOM;
+    if (y > height * w) code |= CLIP_TOP;
+    if (x < -guard_band * w) code |= CLIP_GUARD_LEFT;
+    if (x > (width + guard_band) * w) code |= CLIP_GUARD_RIGHT;
+    if (y < -guard_band * w) code |= CLIP_GUARD_BOTTOM;
+    if (y > (height + guard_band) * w) code |= CLIP_GUARD_TOP;
+    return code;
+}
+
+static ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t) {
+    ClipVertex r;
+    r.pos = a.pos + (b.pos - a.pos) * t;
+    r.world = a.world + (b.world - a.world) * t;
+    r.norm = a.norm + (b.norm - a.norm) * t;
+    r.uv = a.uv + (b.uv - a.uv) * t;
+    return r;
+}
+
+static float plane_distance(const Vec4f& p, unsigned plane, float width, float height) {
+    float x = p[0], y = p[1], w = p[3];
+    switch (plane) {
+    case CLIP_NEAR: return w - near_w;
+    case CLIP_GUARD_LEFT: return x + guard_band * w;
+    case CLIP_GUARD_RIGHT: return (width + guard_band) * w - x;
+    case CLIP_GUARD_BOTTOM: return y + guard_band * w;
+    default: return (height + guard_band) * w - y;
+    }
+}
+
+// One Sutherland-Hodgman pass; returns the new vertex count.
+static int clip_polygon(const ClipVertex* in, int n, ClipVertex* out, unsigned plane, float width, float height) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % n];
+        float da = plane_distance(a.pos, plane, width, height);
+        float db = plane_distance(b.pos, plane, width, height);
+        if (da >= 0.f) out[m++] = a;
+        if ((da >= 0.f) != (db >= 0.f)) out[m++] = lerp(a, b, da / (da - db));
+    }
+    return m;
+}
+
+PrimitiveStage::PrimitiveStage(int width, int height)
+    : width_((float)width), height_((float)height), cull_(CULL_NONE)
+{
+    reset_stats();
+}
+
+void PrimitiveStage::set_cull(CullMode mode) { cull_ = mode; }
+CullMode PrimitiveStage::cull() const { return cull_; }
+
+const PrimitiveStats& PrimitiveStage::stats() const { return stats_; }
+
+void PrimitiveStage::reset_stats() {
+    stats_.submitted = 0;
+    stats_.backface = 0;
+    stats_.frustum = 0;
+    stats_.degenerate = 0;
+    stats_.clipped = 0;
+    stats_.emitted = 0;
+}
+
+bool PrimitiveStage::culled(long long area) const {
+    if (cull_ == CULL_CCW) return area > 0;
+    if (cull_ == CULL_CW) return area < 0;
+    return false;
+}
+
+void PrimitiveStage::emit(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c,
+    const BinnedTriangle& proto, TileRenderer& out)
+{
+    BinnedTriangle t = proto;
+    const ClipVertex* v[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; i++) {
+        t.pts[i] = v[i]->screen;
+        t.world[i] = v[i]->world;
+        t.norms[i] = v[i]->norm;
+        t.uvs[i] = v[i]->uv;
+    }
+    out.submit(t);
+    stats_.emitted++;
+}
+
+void PrimitiveStage::process(const ClipVertex* v, const unsigned* codes,
+    const BinnedTriangle& proto, TileRenderer& out)
+{
+    stats_.submitted++;
+
+    if (codes[0] & codes[1] & codes[2] & CLIP_FRUSTUM) {
+        stats_.frustum++;
+        return;
+    }
+
+    if (!((codes[0] | codes[1] | codes[2]) & CLIP_MUST_CLIP)) {
+        Vec3f pts[3] = { v[0].screen, v[1].screen, v[2].screen };
+        long long area = triangle_raster_area(pts);
+        if (area == 0) {
+            stats_.degenerate++;
+            return;
+        }
+        if (culled(area)) {
+            stats_.backface++;
+            return;
+        }
+        emit(v[0], v[1], v[2], proto, out);
+        return;
+    }
+
+    ClipVertex buf[2][max_clip_verts];
+    int n = 3;
+    for (int i = 0; i < 3; i++) buf[0][i] = v[i];
+
+    int cur = 0;
+    unsigned planes = (codes[0] | codes[1] | codes[2]) & CLIP_MUST_CLIP;
+    for (unsigned plane = CLIP_NEAR; plane <= CLIP_GUARD_TOP && n >= 3; plane <<= 1) {
+        if (!(planes & plane)) continue;
+        n = clip_polygon(buf[cur], n, buf[cur ^ 1], plane, width_, height_);
+        cur ^= 1;
+    }
+    stats_.clipped++;
+    if (n < 3) {
+        stats_.frustum++;
+        return;
+    }
+
+    ClipVertex* poly = buf[cur];
+    for (int i = 0; i < n; i++) {
+        float w = poly[i].pos[3];
+        poly[i].screen = Vec3f(poly[i].pos[0] / w, poly[i].pos[1] / w, poly[i].pos[2] / w);
+    }
+
+    // The clipped polygon is planar and convex, so its fan shares one winding.
+    for (int i = 1; i + 1 < n; i++) {
+        Vec3f pts[3] = { poly[0].screen, poly[i].screen, poly[i + 1].screen };
+        long long area = triangle_raster_area(pts);
+        if (area == 0) {
+            stats_.degenerate++;
+            continue;
+        }
+        if (culled(area)) {
+            stats_.backface++;
+            continue;
+        }
+        emit(poly[0], poly[i], poly[i + 1], proto, out);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef __CLIPPER_H__
+#define __CLIPPER_H__
+
+#include "geometry.h"
+#include "tiler.h"
+
+// Outcode bits of a homogeneous viewport-space position (x, y, z, w), where
+// the screen is x / w in [0, width] and y / w in [0, height].
+enum ClipCode {
+    CLIP_NEAR = 1 << 0,
+    CLIP_LEFT = 1 << 1,
+    CLIP_RIGHT = 1 << 2,
+    CLIP_BOTTOM = 1 << 3,
+    CLIP_TOP = 1 << 4,
+    CLIP_GUARD_LEFT = 1 << 5,
+    CLIP_GUARD_RIGHT = 1 << 6,
+    CLIP_GUARD_BOTTOM = 1 << 7,
+    CLIP_GUARD_TOP = 1 << 8,
+
+    CLIP_FRUSTUM = CLIP_NEAR | CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP,
+    CLIP_MUST_CLIP = CLIP_NEAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP
+};
+
+// Which screen-space winding is thrown away.
+enum CullMode {
+    CULL_NONE,
+    CULL_CW,
+    CULL_CCW
+};
+
+struct ClipVertex {
+    Vec4f pos;
+    Vec3f screen;
+    Vec3f world;
+    Vec3f norm;
+    Vec2f uv;
+};
+
+struct PrimitiveStats {
+    long long submitted;
+    long long backface;
+    long long frustum;
+    long long degenerate;
+    long long clipped;
+    long long emitted;
+};
+
+unsigned clip_outcode(const Vec4f& p, float width, float height);
+
+// Primitive stage between vertex transform and binning: frustum rejection by
+// outcodes, back-face culling, near-plane and guard-band clipping in
+// homogeneous space. Triangles entirely inside the guard band are passed on
+// with their cached screen positions untouched; only the rest are clipped.
+class PrimitiveStage {
+public:
+    PrimitiveStage(int width, int height);
+
+    void set_cull(CullMode mode);
+    CullMode cull() const;
+
+    void process(const ClipVertex* v, const unsigned* codes,
+        const BinnedTriangle& proto, TileRenderer& out);
+
+    const PrimitiveStats& stats() const;
+    void reset_stats();
+
+private:
+    bool culled(long long area) const;
+    void emit(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c,
+        const BinnedTriangle& proto, TileRenderer& out);
+
+private:
+    float width_;
+    float height_;
+    CullMode cull_;
+    PrimitiveStats stats_;
+};
+
+#endif
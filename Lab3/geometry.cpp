@@ -14,8 +14,18 @@ Vec3<float>::Vec3(const Vec3<int>& v)
     : x(v.x), y(v.y), z(v.z) {
 }
 
-Matrix::Matrix(int r, int c)
-    : m(std::vector<std::vector<float> >(r, std::vector<float>(c, 0.f))), rows(r), cols(c) { }
+Matrix::Matrix(int r, int c) : rows(r), cols(c) {
+    assert(r > 0 && r <= DEFAULT_ALLOC && c > 0 && c <= DEFAULT_ALLOC);
+    for (int i = 0; i < DEFAULT_ALLOC; i++)
+        for (int j = 0; j < DEFAULT_ALLOC; j++)
+            m[i][j] = 0.f;
+}
+
+Matrix::Matrix(const Mat4f& a) : rows(4), cols(4) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            m[i][j] = a[i][j];
+}
 
 int Matrix::nrows() {
     return rows;
@@ -35,7 +45,12 @@ Matrix Matrix::identity(int dimensions) {
     return E;
 }
 
-std::vector<float>& Matrix::operator[](const int i) {
+float* Matrix::operator[](const int i) {
+    assert(i >= 0 && i < rows);
+    return m[i];
+}
+
+const float* Matrix::operator[](const int i) const {
     assert(i >= 0 && i < rows);
     return m[i];
 }
@@ -62,40 +77,50 @@ Matrix Matrix::transpose() {
     return result;
 }
 
-Matrix Matrix::inverse() {
-    assert(rows == cols);
-    Matrix result(rows, cols * 2);
+Mat4f Matrix::to_mat4() const {
+    Mat4f r;
     for (int i = 0; i < rows; i++)
         for (int j = 0; j < cols; j++)
-            result[i][j] = m[i][j];
-    for (int i = 0; i < rows; i++)
-        result[i][i + cols] = 1;
-    for (int i = 0; i < rows - 1; i++) {
-        for (int j = result.cols - 1; j >= 0; j--)
-            result[i][j] /= result[i][i];
-        for (int k = i + 1; k < rows; k++) {
-            float coeff = result[k][i];
-            for (int j = 0; j < result.cols; j++) {
-                result[k][j] -= result[i][j] * coeff;
+            r[i][j] = m[i][j];
+    return r;
+}
+
+Matrix Matrix::inverse() {
+    assert(rows == cols);
+    if (rows == 4) return Matrix(::inverse(to_mat4()));
+
+    const int n = rows;
+    float aug[DEFAULT_ALLOC][DEFAULT_ALLOC * 2];
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n * 2; j++)
+            aug[i][j] = (j < n ? m[i][j] : (j - n == i ? 1.f : 0.f));
+
+    for (int i = 0; i < n - 1; i++) {
+        for (int j = n * 2 - 1; j >= 0; j--)
+            aug[i][j] /= aug[i][i];
+        for (int k = i + 1; k < n; k++) {
+            float coeff = aug[k][i];
+            for (int j = 0; j < n * 2; j++) {
+                aug[k][j] -= aug[i][j] * coeff;
             }
         }
     }
-    for (int j = result.cols - 1; j >= rows - 1; j--)
-        result[rows - 1][j] /= result[rows - 1][rows - 1];
+    for (int j = n * 2 - 1; j >= n - 1; j--)
+        aug[n - 1][j] /= aug[n - 1][n - 1];
 
-    for (int i = rows - 1; i > 0; i--) {
+    for (int i = n - 1; i > 0; i--) {
         for (int k = i - 1; k >= 0; k--) {
-            float coeff = result[k][i];
-            for (int j = 0; j < result.cols; j++) {
-                result[k][j] -= result[i][j] * coeff;
+            float coeff = aug[k][i];
+            for (int j = 0; j < n * 2; j++) {
+                aug[k][j] -= aug[i][j] * coeff;
             }
         }
     }
 
-    Matrix truncate(rows, cols);
-    for (int i = 0; i < rows; i++)
-        for (int j = 0; j < cols; j++)
-            truncate[i][j] = result[i][j + cols];
+    Matrix truncate(n, n);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            truncate[i][j] = aug[i][j + n];
     return truncate;
 }
 
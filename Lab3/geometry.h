@@ -4,6 +4,12 @@
 #include <cmath>
 #include <vector>
 #include <iostream>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GEOMETRY_SSE 1
+#include <xmmintrin.h>
+#endif
 
 template <class t> struct Vec2 {
     t x, y;
@@ -90,21 +96,239 @@ std::ostream& operator<<(std::ostream& s, Vec3<t>& v) {
 }
 
 
+// Fixed-dimension vector and matrix templates. Storage is inline, so none of
+// these ever touch the heap, and everything but norm() is constexpr.
+template <int N, class T> struct vec {
+    T data[N];
+
+    constexpr vec() : data() {}
+    template <class... A, class = typename std::enable_if<sizeof...(A) == N>::type>
+    constexpr vec(A... a) : data{ T(a)... } {}
+
+    constexpr T& operator[](const int i) { return data[i]; }
+    constexpr const T& operator[](const int i) const { return data[i]; }
+};
+
+template <int N, class T>
+constexpr vec<N, T> operator+(const vec<N, T>& a, const vec<N, T>& b) {
+    vec<N, T> r;
+    for (int i = 0; i < N; i++) r[i] = a[i] + b[i];
+    return r;
+}
+
+template <int N, class T>
+constexpr vec<N, T> operator-(const vec<N, T>& a, const vec<N, T>& b) {
+    vec<N, T> r;
+    for (int i = 0; i < N; i++) r[i] = a[i] - b[i];
+    return r;
+}
+
+template <int N, class T>
+constexpr vec<N, T> operator*(const vec<N, T>& a, T f) {
+    vec<N, T> r;
+    for (int i = 0; i < N; i++) r[i] = a[i] * f;
+    return r;
+}
+
+template <int N, class T>
+constexpr T operator*(const vec<N, T>& a, const vec<N, T>& b) {
+    T s = T();
+    for (int i = 0; i < N; i++) s += a[i] * b[i];
+    return s;
+}
+
+template <class T>
+constexpr vec<3, T> cross(const vec<3, T>& a, const vec<3, T>& b) {
+    return vec<3, T>(a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]);
+}
+
+template <int N, class T>
+T norm(const vec<N, T>& a) {
+    return std::sqrt(a * a);
+}
+
+template <int R, int C, class T> struct mat {
+    vec<C, T> rows[R];
+
+    constexpr mat() : rows() {}
+
+    constexpr vec<C, T>& operator[](const int i) { return rows[i]; }
+    constexpr const vec<C, T>& operator[](const int i) const { return rows[i]; }
+
+    constexpr vec<R, T> col(const int j) const {
+        vec<R, T> r;
+        for (int i = 0; i < R; i++) r[i] = rows[i][j];
+        return r;
+    }
+
+    constexpr mat<C, R, T> transpose() const {
+        mat<C, R, T> r;
+        for (int i = 0; i < R; i++)
+            for (int j = 0; j < C; j++)
+                r[j][i] = rows[i][j];
+        return r;
+    }
+
+    static constexpr mat identity() {
+        mat r;
+        for (int i = 0; i < R; i++)
+            for (int j = 0; j < C; j++)
+                r[i][j] = (i == j ? T(1) : T(0));
+        return r;
+    }
+};
+
+template <int R, int K, int C, class T>
+constexpr mat<R, C, T> operator*(const mat<R, K, T>& a, const mat<K, C, T>& b) {
+    mat<R, C, T> r;
+    for (int i = 0; i < R; i++) {
+        for (int j = 0; j < C; j++) {
+            T s = T();
+            for (int k = 0; k < K; k++) s += a[i][k] * b[k][j];
+            r[i][j] = s;
+        }
+    }
+    return r;
+}
+
+template <int R, int C, class T>
+constexpr vec<R, T> operator*(const mat<R, C, T>& a, const vec<C, T>& v) {
+    vec<R, T> r;
+    for (int i = 0; i < R; i++) {
+        T s = T();
+        for (int k = 0; k < C; k++) s += a[i][k] * v[k];
+        r[i] = s;
+    }
+    return r;
+}
+
+// Closed-form inverse through the 2x2 sub-determinants of the top and
+// bottom row pairs (Laplace expansion). A singular matrix yields inf/nan.
+template <class T>
+constexpr mat<4, 4, T> inverse(const mat<4, 4, T>& m) {
+    T s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+    T s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+    T s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+    T s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+    T s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+    T s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+    T c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+    T c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+    T c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+    T c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+    T c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+    T c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+
+    T inv = T(1) / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+    mat<4, 4, T> r;
+    r[0][0] = ( m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * inv;
+    r[0][1] = (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * inv;
+    r[0][2] = ( m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * inv;
+    r[0][3] = (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * inv;
+
+    r[1][0] = (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * inv;
+    r[1][1] = ( m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * inv;
+    r[1][2] = (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * inv;
+    r[1][3] = ( m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * inv;
+
+    r[2][0] = ( m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * inv;
+    r[2][1] = (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * inv;
+    r[2][2] = ( m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * inv;
+    r[2][3] = (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * inv;
+
+    r[3][0] = (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * inv;
+    r[3][1] = ( m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * inv;
+    r[3][2] = (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * inv;
+    r[3][3] = ( m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * inv;
+    return r;
+}
+
+typedef vec<4, float> Vec4f;
+typedef mat<4, 4, float> Mat4f;
+
+#ifdef GEOMETRY_SSE
+// 4-wide float overloads. Each lane accumulates its products in the same
+// order as the generic templates, so results are bit-identical to them.
+inline Vec4f operator+(const Vec4f& a, const Vec4f& b) {
+    Vec4f r;
+    _mm_storeu_ps(r.data, _mm_add_ps(_mm_loadu_ps(a.data), _mm_loadu_ps(b.data)));
+    return r;
+}
+
+inline Vec4f operator-(const Vec4f& a, const Vec4f& b) {
+    Vec4f r;
+    _mm_storeu_ps(r.data, _mm_sub_ps(_mm_loadu_ps(a.data), _mm_loadu_ps(b.data)));
+    return r;
+}
+
+inline Vec4f operator*(const Vec4f& a, float f) {
+    Vec4f r;
+    _mm_storeu_ps(r.data, _mm_mul_ps(_mm_loadu_ps(a.data), _mm_set1_ps(f)));
+    return r;
+}
+
+inline Vec4f operator*(const Mat4f& m, const Vec4f& v) {
+    __m128 r0 = _mm_loadu_ps(m[0].data);
+    __m128 r1 = _mm_loadu_ps(m[1].data);
+    __m128 r2 = _mm_loadu_ps(m[2].data);
+    __m128 r3 = _mm_loadu_ps(m[3].data);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    __m128 s = _mm_mul_ps(r0, _mm_set1_ps(v[0]));
+    s = _mm_add_ps(s, _mm_mul_ps(r1, _mm_set1_ps(v[1])));
+    s = _mm_add_ps(s, _mm_mul_ps(r2, _mm_set1_ps(v[2])));
+    s = _mm_add_ps(s, _mm_mul_ps(r3, _mm_set1_ps(v[3])));
+
+    Vec4f r;
+    _mm_storeu_ps(r.data, s);
+    return r;
+}
+
+inline Mat4f operator*(const Mat4f& a, const Mat4f& b) {
+    __m128 b0 = _mm_loadu_ps(b[0].data);
+    __m128 b1 = _mm_loadu_ps(b[1].data);
+    __m128 b2 = _mm_loadu_ps(b[2].data);
+    __m128 b3 = _mm_loadu_ps(b[3].data);
+
+    Mat4f r;
+    for (int i = 0; i < 4; i++) {
+        __m128 s = _mm_mul_ps(_mm_set1_ps(a[i][0]), b0);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i][1]), b1));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i][2]), b2));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i][3]), b3));
+        _mm_storeu_ps(r[i].data, s);
+    }
+    return r;
+}
+#endif
+
+inline Vec4f embed(const Vec3f& v, float w = 1.f) {
+    return Vec4f(v.x, v.y, v.z, w);
+}
+
+
 const int DEFAULT_ALLOC = 4;
 
+// Dynamically sized view over a fixed 4x4 block, kept for the existing
+// lookat/viewport/projection code. Dimensions may be anything up to 4x4.
 class Matrix {
-    std::vector<std::vector<float> > m;
+    float m[DEFAULT_ALLOC][DEFAULT_ALLOC];
     int rows, cols;
 public:
     Matrix(int r = DEFAULT_ALLOC, int c = DEFAULT_ALLOC);
+    Matrix(const Mat4f& a);
     inline int nrows();
     inline int ncols();
 
     static Matrix identity(int dimensions);
-    std::vector<float>& operator[](const int i);
+    float* operator[](const int i);
+    const float* operator[](const int i) const;
     Matrix operator*(const Matrix& a);
     Matrix transpose();
     Matrix inverse();
+    Mat4f to_mat4() const;
 
     friend std::ostream& operator<<(std::ostream& s, Matrix& m);
 };
@@ -2,17 +2,8 @@
 #include <limits>
 #include <cmath>
 #include "graphics.h"
-
-const int width = 1920;
-const int height = 1920;
-const int depth = 255;
-
-Model* model = nullptr;
-float* zbuffer = nullptr;
-
-Matrix ModelView;
-Matrix Viewport;
-Matrix Projection;
+#include "shader.h"
+#include "shade_simd.h"
 
 static const float shininess = 64.0f;
 static const float ambientStrength = 0.30f;
@@ -63,7 +54,7 @@ static TGAColor phongColor(const Vec3f& N_in,
         albedo.a);
 }
 
-void lookat(const Vec3f& eye, const Vec3f& center, const Vec3f& up) {
+Matrix lookat(const Vec3f& eye, const Vec3f& center, const Vec3f& up) {
     Vec3f z = (eye - center).normalize();
     Vec3f x = (up ^ z).normalize();
     Vec3f y = (z ^ x).normalize();
@@ -77,10 +68,10 @@ void lookat(const Vec3f& eye, const Vec3f& center, const Vec3f& up) {
         Minv[2][i] = z[i];
         Tr[i][3] = -eye[i];
     }
-    ModelView = Minv * Tr;
+    return Minv * Tr;
 }
 
-Matrix viewport(int x, int y, int w, int h) {
+Matrix viewport(int x, int y, int w, int h, int depth) {
     Matrix m = Matrix::identity(4);
     m[0][3] = x + w / 2.f;
     m[1][3] = y + h / 2.f;
@@ -107,10 +98,10 @@ Vec3f barycentric(const Vec3f* pts, const Vec2i& P) {
     return Vec3f(w, u, v);
 }
 
-void triangle_flat(Vec3f* pts, TGAImage& image, TGAColor color, float* zb) {
-    Vec2i bboxmin(width - 1, height - 1);
-    Vec2i bboxmax(0, 0);
-    Vec2i clampv(width - 1, height - 1);
+void bbox_of_triangle(const Vec3f* pts, int w, int h, Vec2i& bboxmin, Vec2i& bboxmax, const TileRect* clip) {
+    bboxmin = Vec2i(w - 1, h - 1);
+    bboxmax = Vec2i(0, 0);
+    Vec2i clampv(w - 1, h - 1);
 
     for (int i = 0; i < 3; i++) {
         bboxmin.x = std::max(0, std::min(bboxmin.x, (int)pts[i].x));
@@ -119,150 +110,216 @@ void triangle_flat(Vec3f* pts, TGAImage& image, TGAColor color, float* zb) {
         bboxmax.y = std::min(clampv.y, std::max(bboxmax.y, (int)pts[i].y));
     }
 
-    Vec2i P;
-    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-            Vec3f bc = barycentric(pts, P);
-            if (bc.x < 0.f || bc.y < 0.f || bc.z < 0.f) continue;
+    if (clip) {
+        bboxmin.x = std::max(bboxmin.x, clip->x0);
+        bboxmin.y = std::max(bboxmin.y, clip->y0);
+        bboxmax.x = std::min(bboxmax.x, clip->x1);
+        bboxmax.y = std::min(bboxmax.y, clip->y1);
+    }
+}
 
-            float z = pts[0].z * bc.x + pts[1].z * bc.y + pts[2].z * bc.z;
-            int idx = P.x + P.y * width;
-            if (idx < 0 || idx >= width * height) continue;
+static const int subpixel_bits = 8;
+static const float subpixel_scale = (float)(1 << subpixel_bits);
+static const float max_raster_coord = (float)(1 << 21);
 
-            if (zb[idx] < z) {
-                zb[idx] = z;
-                image.set(P.x, P.y, color);
-            }
-        }
-    }
+static inline long long floor_div(long long a, long long b) {
+    long long q = a / b;
+    return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
 }
 
-static void bbox_of_triangle(Vec3f* pts, Vec2i& bboxmin, Vec2i& bboxmax) {
-    bboxmin = Vec2i(width - 1, height - 1);
-    bboxmax = Vec2i(0, 0);
-    Vec2i clampv(width - 1, height - 1);
+static inline long long ceil_div(long long a, long long b) {
+    return -floor_div(-a, b);
+}
 
+static bool snap_triangle(const Vec3f* pts, long long* X, long long* Y, long long& area) {
     for (int i = 0; i < 3; i++) {
-        bboxmin.x = std::max(0, std::min(bboxmin.x, (int)pts[i].x));
-        bboxmin.y = std::max(0, std::min(bboxmin.y, (int)pts[i].y));
-        bboxmax.x = std::min(clampv.x, std::max(bboxmax.x, (int)pts[i].x));
-        bboxmax.y = std::min(clampv.y, std::max(bboxmax.y, (int)pts[i].y));
+        if (!(std::abs(pts[i].x) < max_raster_coord && std::abs(pts[i].y) < max_raster_coord)) return false;
+        X[i] = std::llround(pts[i].x * subpixel_scale);
+        Y[i] = std::llround(pts[i].y * subpixel_scale);
     }
-}
 
-void triangle_phong_flat(Vec3f* pts, Vec3f* norms, Vec3f* worldPos,
-    TGAImage& image, float* zb,
-    const Vec3f& light_dir, const Vec3f& eyePos,
-    const TGAColor& albedo)
-{
-    Vec2i bboxmin, bboxmax;
-    bbox_of_triangle(pts, bboxmin, bboxmax);
+    area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+    return std::abs((float)area) >= 1e-2f * subpixel_scale * subpixel_scale;
+}
 
-    Vec2i P;
-    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-            Vec3f bc = barycentric(pts, P);
-            if (bc.x < 0.f || bc.y < 0.f || bc.z < 0.f) continue;
+long long triangle_raster_area(const Vec3f* pts) {
+    long long X[3], Y[3], area;
+    return snap_triangle(pts, X, Y, area) ? area : 0;
+}
 
-            float z = pts[0].z * bc.x + pts[1].z * bc.y + pts[2].z * bc.z;
-            int idx = P.x + P.y * width;
-            if (idx < 0 || idx >= width * height) continue;
+bool setup_triangle(const Vec3f* pts, int w, int h, const TileRect* clip, TriangleSetup& ts) {
+    long long X[3], Y[3], area;
+    if (!snap_triangle(pts, X, Y, area)) return false;
+    long long sign = area > 0 ? 1 : -1;
 
-            if (zb[idx] < z) {
-                zb[idx] = z;
+    for (int i = 0; i < 3; i++) {
+        int a = (i + 1) % 3;
+        int b = (i + 2) % 3;
+        long long dx = (X[b] - X[a]) * sign;
+        long long dy = (Y[b] - Y[a]) * sign;
+
+        ts.A[i] = -dy * (1 << subpixel_bits);
+        ts.B[i] = dx * (1 << subpixel_bits);
+        ts.C[i] = dy * X[a] - dx * Y[a];
+        bool top_left = dy < 0 || (dy == 0 && dx < 0);
+        ts.bias[i] = top_left ? 0 : -1;
+    }
+    ts.inv_area = 1.f / (float)(area * sign);
 
-                Vec3f N = norms[0] * bc.x + norms[1] * bc.y + norms[2] * bc.z;
-                N.normalize();
+    double inv = 1.0 / (double)(area * sign);
+    ts.zmax = std::max(pts[0].z, std::max(pts[1].z, pts[2].z));
+    ts.zdx = ((pts[0].z * (double)ts.A[0] + pts[1].z * (double)ts.A[1] + pts[2].z * (double)ts.A[2]) * inv);
+    ts.zdy = ((pts[0].z * (double)ts.B[0] + pts[1].z * (double)ts.B[1] + pts[2].z * (double)ts.B[2]) * inv);
+    ts.zc = ((pts[0].z * (double)ts.C[0] + pts[1].z * (double)ts.C[1] + pts[2].z * (double)ts.C[2]) * inv);
 
-                Vec3f fragPos = worldPos[0] * bc.x + worldPos[1] * bc.y + worldPos[2] * bc.z;
+    bbox_of_triangle(pts, w, h, ts.bboxmin, ts.bboxmax, clip);
+    return ts.bboxmin.x <= ts.bboxmax.x && ts.bboxmin.y <= ts.bboxmax.y;
+}
 
-                image.set(P.x, P.y, phongColor(N, fragPos, light_dir, eyePos, albedo));
-            }
-        }
+bool triangle_span(const TriangleSetup& ts, int y, int& x0, int& x1) {
+    x0 = ts.bboxmin.x;
+    x1 = ts.bboxmax.x;
+    for (int i = 0; i < 3; i++) {
+        long long e = ts.B[i] * y + ts.C[i] + ts.bias[i];
+        if (ts.A[i] > 0) x0 = (int)std::max((long long)x0, ceil_div(-e, ts.A[i]));
+        else if (ts.A[i] < 0) x1 = (int)std::min((long long)x1, floor_div(e, -ts.A[i]));
+        else if (e < 0) return false;
     }
+    return x0 <= x1;
 }
 
-void triangle_phong_tex(Vec3f* pts, Vec2f* uvs, Vec3f* norms, Vec3f* worldPos,
-    TGAImage& image, float* zb,
-    const Vec3f& light_dir, const Vec3f& eyePos)
+TGAColor shade_phong_flat(const Vec3f& bc, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos, const TGAColor& albedo)
 {
-    Vec2i bboxmin, bboxmax;
-    bbox_of_triangle(pts, bboxmin, bboxmax);
+    Vec3f N = norms[0] * bc.x + norms[1] * bc.y + norms[2] * bc.z;
+    N.normalize();
 
-    int texW = model->diffuse_width();
-    int texH = model->diffuse_height();
+    Vec3f fragPos = worldPos[0] * bc.x + worldPos[1] * bc.y + worldPos[2] * bc.z;
 
-    Vec2i P;
-    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-            Vec3f bc = barycentric(pts, P);
-            if (bc.x < 0.f || bc.y < 0.f || bc.z < 0.f) continue;
+    return phongColor(N, fragPos, light_dir, eyePos, albedo);
+}
 
-            float z = pts[0].z * bc.x + pts[1].z * bc.y + pts[2].z * bc.z;
-            int idx = P.x + P.y * width;
-            if (idx < 0 || idx >= width * height) continue;
+TGAColor shade_phong_tex(const RenderContext& ctx, const Vec3f& bc, const Vec2f* uvs, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos, float lod)
+{
+    int texW = ctx.diffuse->get_width();
+    int texH = ctx.diffuse->get_height();
 
-            if (zb[idx] < z) {
-                zb[idx] = z;
+    float u = uvs[0].x * bc.x + uvs[1].x * bc.y + uvs[2].x * bc.z;
+    float v = uvs[0].y * bc.x + uvs[1].y * bc.y + uvs[2].y * bc.z;
 
-                float u = uvs[0].x * bc.x + uvs[1].x * bc.y + uvs[2].x * bc.z;
-                float v = uvs[0].y * bc.x + uvs[1].y * bc.y + uvs[2].y * bc.z;
+    if (ctx.filter != TEX_POINT && ctx.diffuse_mips) {
+        TGAColor albedo = ctx.diffuse_mips->sample(u, v, lod, ctx.filter);
+        return shade_phong_flat(bc, norms, worldPos, light_dir, eyePos, albedo);
+    }
 
-                int tx = std::max(0, std::min(texW - 1, (int)(u * texW)));
-                int ty = std::max(0, std::min(texH - 1, (int)(v * texH)));
+    int tx = std::max(0, std::min(texW - 1, (int)(u * texW)));
+    int ty = std::max(0, std::min(texH - 1, (int)(v * texH)));
 
-                TGAColor albedo = model->diffuse(Vec2i(tx, ty));
+    return shade_phong_flat(bc, norms, worldPos, light_dir, eyePos, ctx.diffuse->get(tx, ty));
+}
 
-                Vec3f N = norms[0] * bc.x + norms[1] * bc.y + norms[2] * bc.z;
-                N.normalize();
+void triangle_flat(const RenderContext& ctx, const Vec3f* pts, TGAColor color, const TileRect* clip) {
+    FlatShader shader;
+    shader.pts = pts;
+    shader.color = color;
+    draw_triangle(shader, *ctx.target, clip);
+}
 
-                Vec3f fragPos = worldPos[0] * bc.x + worldPos[1] * bc.y + worldPos[2] * bc.z;
+void triangle_phong_flat(const RenderContext& ctx, const Vec3f* pts, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos,
+    const TGAColor& albedo, const TileRect* clip)
+{
+    PhongFlatShader shader;
+    shader.pts = pts;
+    shader.norms = norms;
+    shader.world = worldPos;
+    shader.light_dir = light_dir;
+    shader.eye = eyePos;
+    shader.albedo = albedo;
+    draw_triangle(shader, *ctx.target, clip);
+}
 
-                image.set(P.x, P.y, phongColor(N, fragPos, light_dir, eyePos, albedo));
-            }
+void triangle_phong_tex(const RenderContext& ctx, const Vec3f* pts, const Vec2f* uvs, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos, const TileRect* clip)
+{
+    RenderTarget& target = *ctx.target;
+    TGAImage& image = target.color();
+    int texW = ctx.diffuse->get_width();
+    int texH = ctx.diffuse->get_height();
+    int texBpp = ctx.diffuse->get_bytespp();
+    int imageBpp = image.get_bytespp();
+
+    // The span kernels only point-sample.
+    bool filtered = ctx.filter != TEX_POINT && ctx.diffuse_mips;
+    PhongTexSpanFn kernel = filtered ? nullptr : phong_tex_span_kernel();
+    if (kernel && shininess == (float)(int)shininess
+        && (texBpp == 3 || texBpp == 4) && (imageBpp == 3 || imageBpp == 4))
+    {
+        TriangleSetup ts;
+        if (!setup_triangle(pts, target.width(), target.height(), clip, ts)) return;
+
+        PhongTexTriangle t;
+        t.ts = &ts;
+        t.pts = pts;
+        t.uvs = uvs;
+        t.norms = norms;
+        t.world = worldPos;
+        t.tex = ctx.diffuse->buffer();
+        t.texW = texW;
+        t.texH = texH;
+        t.texBpp = texBpp;
+        t.image = image.buffer();
+        t.imageBpp = imageBpp;
+        t.zb = target.depth();
+        t.width = target.width();
+        t.L = light_dir;
+        t.L.normalize();
+        t.minusL = t.L * -1.f;
+        t.eye = eyePos;
+        t.ambient = ambientStrength;
+        t.diffuse = diffuseStrength;
+        t.specular = specularStrength;
+        t.spec_power = (int)shininess;
+
+        if (!profiling()) {
+            raster_triangle(ts, target, true, [&](int y, int x0, int x1) { kernel(t, y, x0, x1); });
+            return;
         }
+        long long tested = 0, written = 0;
+        raster_triangle(ts, target, true, [&](int y, int x0, int x1) {
+            tested += x1 - x0 + 1;
+            written += kernel(t, y, x0, x1);
+        });
+        profile_fragments(tested, written, written);
+        return;
     }
-}
-static inline unsigned char clamp_u8(int x) {
-    if (x < 0) return 0;
-    if (x > 255) return 255;
-    return (unsigned char)x;
-}
 
-static inline TGAColor alpha_blend(const TGAColor& dst, const TGAColor& src, float a) {
-    int r = (int)(src.r * a + dst.r * (1.f - a));
-    int g = (int)(src.g * a + dst.g * (1.f - a));
-    int b = (int)(src.b * a + dst.b * (1.f - a));
-    return TGAColor(clamp_u8(b), clamp_u8(g), clamp_u8(r), 255);
+    PhongTexShader shader;
+    shader.ctx = &ctx;
+    shader.pts = pts;
+    shader.uvs = uvs;
+    shader.norms = norms;
+    shader.world = worldPos;
+    shader.light_dir = light_dir;
+    shader.eye = eyePos;
+    shader.lod = filtered ? texture_lod(pts, uvs, texW, texH) : 0.f;
+    draw_triangle(shader, target, clip);
 }
 
-void triangle_alpha(Vec3f* pts, TGAImage& image, TGAColor src, float alpha, float* zb) {
-    Vec2i bboxmin(width - 1, height - 1);
-    Vec2i bboxmax(0, 0);
-    Vec2i clamp(width - 1, height - 1);
-
-    for (int i = 0; i < 3; i++) {
-        bboxmin.x = std::max(0, std::min(bboxmin.x, (int)pts[i].x));
-        bboxmin.y = std::max(0, std::min(bboxmin.y, (int)pts[i].y));
-        bboxmax.x = std::min(clamp.x, std::max(bboxmax.x, (int)pts[i].x));
-        bboxmax.y = std::min(clamp.y, std::max(bboxmax.y, (int)pts[i].y));
-    }
+void triangle_alpha(const RenderContext& ctx, const Vec3f* pts, TGAColor src, float alpha, const TileRect* clip) {
+    AlphaShader shader;
+    shader.pts = pts;
+    shader.color = src;
+    shader.alpha = alpha;
+    draw_triangle(shader, *ctx.target, clip);
+}
 
-    Vec2i P;
-    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-            Vec3f bc = barycentric(pts, P);
-            if (bc.x < 0.f || bc.y < 0.f || bc.z < 0.f) continue;
-
-            float z = pts[0].z * bc.x + pts[1].z * bc.y + pts[2].z * bc.z;
-            int idx = P.x + P.y * width;
-            if (idx < 0 || idx >= width * height) continue;
-            if (z > zb[idx]) {
-                TGAColor dst = image.get(P.x, P.y);
-                TGAColor out = alpha_blend(dst, src, alpha);
-                image.set(P.x, P.y, out);
-
-            }
-        }
-    }
+void triangle_visibility(const RenderContext& ctx, const Vec3f* pts, int id, int* ids, Vec3f* bary, const TileRect* clip) {
+    VisibilityShader shader;
+    shader.pts = pts;
+    shader.id = id;
+    shader.ids = ids;
+    shader.bary = bary;
+    draw_triangle(shader, *ctx.target, clip);
 }
@@ -3,36 +3,59 @@
 
 #include "geometry.h"
 #include "tgaimage.h"
-#include "model.h"
-
-extern const int width;
-extern const int height;
-extern const int depth;
-
-extern Model* model;
-extern float* zbuffer;
-
-extern Matrix ModelView;
-extern Matrix Viewport;
-extern Matrix Projection;
-
-void lookat(const Vec3f& eye, const Vec3f& center, const Vec3f& up);
-Matrix viewport(int x, int y, int w, int h);
+#include "hiz.h"
+#include "render_context.h"
+
+Matrix lookat(const Vec3f& eye, const Vec3f& center, const Vec3f& up);
+Matrix viewport(int x, int y, int w, int h, int depth = 255);
+
+// Fixed-point edge equations of a screen-space triangle, normalized so that
+// covered pixels give E >= 0. Edge i is opposite vertex i, so E_i / area is
+// the barycentric weight of vertex i. bias carries the top-left fill rule.
+// The depth plane z = zc + zdx * x + zdy * y bounds blocks for HiZ culling.
+struct TriangleSetup {
+    long long A[3], B[3], C[3];
+    long long bias[3];
+    float inv_area;
+    float zmax;
+    double zdx, zdy, zc;
+    Vec2i bboxmin, bboxmax;
+};
 
 Vec3f barycentric(const Vec3f* pts, const Vec2i& P);
-
-void triangle_flat(Vec3f* pts, TGAImage& image, TGAColor color, float* zb);
-
-void triangle_phong_flat(Vec3f* pts, Vec3f* norms, Vec3f* worldPos,
-    TGAImage& image, float* zb,
+// Pixel bounds of the triangle on a w x h target, cut down to clip if given.
+void bbox_of_triangle(const Vec3f* pts, int w, int h, Vec2i& bboxmin, Vec2i& bboxmax, const TileRect* clip = nullptr);
+
+// Twice the signed area in subpixel units as the rasterizer sees it, or 0
+// when setup_triangle() would reject the triangle as degenerate.
+long long triangle_raster_area(const Vec3f* pts);
+bool setup_triangle(const Vec3f* pts, int w, int h, const TileRect* clip, TriangleSetup& ts);
+bool triangle_span(const TriangleSetup& ts, int y, int& x0, int& x1);
+
+TGAColor shade_phong_flat(const Vec3f& bc, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos, const TGAColor& albedo);
+// Samples the context's diffuse map. lod is only used by the filtered modes
+// (see texture.h).
+TGAColor shade_phong_tex(const RenderContext& ctx, const Vec3f& bc, const Vec2f* uvs, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos, float lod = 0.f);
+
+// The triangle_* routines draw into ctx.target, testing and writing its
+// depth (and HiZ, when the target has one).
+void triangle_flat(const RenderContext& ctx, const Vec3f* pts, TGAColor color, const TileRect* clip = nullptr);
+
+void triangle_phong_flat(const RenderContext& ctx, const Vec3f* pts, const Vec3f* norms, const Vec3f* worldPos,
     const Vec3f& light_dir, const Vec3f& eyePos,
-    const TGAColor& albedo);
+    const TGAColor& albedo, const TileRect* clip = nullptr);
+
+void triangle_alpha(const RenderContext& ctx, const Vec3f* pts, TGAColor src, float alpha, const TileRect* clip = nullptr);
 
-void triangle_alpha(Vec3f* pts, TGAImage& image, TGAColor src, float alpha, float* zb);
 
+void triangle_phong_tex(const RenderContext& ctx, const Vec3f* pts, const Vec2f* uvs, const Vec3f* norms, const Vec3f* worldPos,
+    const Vec3f& light_dir, const Vec3f& eyePos, const TileRect* clip = nullptr);
 
-void triangle_phong_tex(Vec3f* pts, Vec2f* uvs, Vec3f* norms, Vec3f* worldPos,
-    TGAImage& image, float* zb,
-    const Vec3f& light_dir, const Vec3f& eyePos);
+// First pass of deferred shading: depth test only, recording the winning
+// triangle id and its barycentrics per pixel. All three weights are kept so
+// the resolve shades with exactly the values the forward path would use.
+void triangle_visibility(const RenderContext& ctx, const Vec3f* pts, int id, int* ids, Vec3f* bary, const TileRect* clip = nullptr);
 
 #endif
\ No newline at end of file
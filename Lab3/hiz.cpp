@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <limits>
+#include "hiz.h"
+
+HiZBuffer::HiZBuffer(float* zb, int w, int h, int nlevels)
+    : triangles_tested(0), triangles_culled(0), blocks_tested(0), blocks_culled(0),
+    zb_(zb), width_(w), height_(h), levels_(std::max(1, nlevels))
+{
+    for (int l = 0; l < (int)levels_.size(); l++) {
+        Level& lv = levels_[l];
+        lv.shift = block_shift * (l + 1);
+        int size = 1 << lv.shift;
+        lv.nx = (w + size - 1) / size;
+        lv.ny = (h + size - 1) / size;
+        lv.zmin.resize(lv.nx * lv.ny);
+        lv.dirty.resize(lv.nx * lv.ny);
+    }
+    reset();
+}
+
+float* HiZBuffer::depth() const { return zb_; }
+int HiZBuffer::nlevels() const { return (int)levels_.size(); }
+int HiZBuffer::cell_size(int level) const { return 1 << levels_[level].shift; }
+
+void HiZBuffer::reset() {
+    for (Level& lv : levels_) {
+        std::fill(lv.zmin.begin(), lv.zmin.end(), -std::numeric_limits<float>::infinity());
+        std::fill(lv.dirty.begin(), lv.dirty.end(), 1);
+    }
+}
+
+void HiZBuffer::mark_dirty(int bx, int by) {
+    for (int l = 0; l < (int)levels_.size(); l++) {
+        Level& lv = levels_[l];
+        int shift = lv.shift - block_shift;
+        lv.dirty[(bx >> shift) + (by >> shift) * lv.nx] = 1;
+    }
+}
+
+void HiZBuffer::refresh(int level, int cx, int cy) {
+    Level& lv = levels_[level];
+    float m = std::numeric_limits<float>::infinity();
+
+    if (level == 0) {
+        int x0 = cx << block_shift, y0 = cy << block_shift;
+        int x1 = std::min(width_, x0 + block_size);
+        int y1 = std::min(height_, y0 + block_size);
+        for (int y = y0; y < y1; y++) {
+            const float* row = zb_ + y * width_;
+            for (int x = x0; x < x1; x++) m = std::min(m, row[x]);
+        }
+    }
+    else {
+        // Children may be dirty too; a never-queried one still holds -inf.
+        const Level& child = levels_[level - 1];
+        int x0 = cx << block_shift, y0 = cy << block_shift;
+        int x1 = std::min(child.nx, x0 + block_size);
+        int y1 = std::min(child.ny, y0 + block_size);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) m = std::min(m, cell_min(level - 1, x, y));
+        }
+    }
+
+    lv.zmin[cx + cy * lv.nx] = m;
+    lv.dirty[cx + cy * lv.nx] = 0;
+}
+
+float HiZBuffer::cell_min(int level, int cx, int cy) {
+    Level& lv = levels_[level];
+    if (lv.dirty[cx + cy * lv.nx]) refresh(level, cx, cy);
+    return lv.zmin[cx + cy * lv.nx];
+}
+
+bool HiZBuffer::reject_rect(int x0, int y0, int x1, int y1, float zmax) {
+    int level = (int)levels_.size() - 1;
+    const Level& lv = levels_[level];
+    float m = std::numeric_limits<float>::infinity();
+    for (int cy = y0 >> lv.shift; cy <= (y1 >> lv.shift); cy++) {
+        for (int cx = x0 >> lv.shift; cx <= (x1 >> lv.shift); cx++) {
+            m = std::min(m, cell_min(level, cx, cy));
+            if (zmax > m) return false;
+        }
+    }
+    return true;
+}
+
+bool HiZBuffer::reject_block(int bx, int by, float zmax) {
+    return zmax <= cell_min(0, bx, by);
+}
+
+void HiZBuffer::add_stats(long long tris_tested, long long tris_culled,
+    long long blks_tested, long long blks_culled)
+{
+    triangles_tested.fetch_add(tris_tested, std::memory_order_relaxed);
+    triangles_culled.fetch_add(tris_culled, std::memory_order_relaxed);
+    blocks_tested.fetch_add(blks_tested, std::memory_order_relaxed);
+    blocks_culled.fetch_add(blks_culled, std::memory_order_relaxed);
+}
+
+void HiZBuffer::reset_stats() {
+    triangles_tested = 0;
+    triangles_culled = 0;
+    blocks_tested = 0;
+    blocks_culled = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef __HIZ_H__
+#define __HIZ_H__
+
+#include <atomic>
+#include <vector>
+
+// Hierarchical depth kept alongside a flat z-buffer. Level 0 stores the
+// minimum depth of each 8x8 block, every further level the minimum of 8x8
+// cells of the level below (64x64, 512x512, ...).
+//
+// The depth test is "zb < z", so stored depths only ever grow and a stale
+// minimum is still a valid lower bound. Writers just mark blocks dirty and
+// the minimum is re-tightened lazily the next time a cell is queried. Only
+// the minimum is kept: it is all that rejection needs under this test.
+//
+// A cell must be owned by a single thread, so multithreaded callers need
+// tiles that are multiples of the coarsest cell size.
+class HiZBuffer {
+public:
+    enum { block_shift = 3, block_size = 1 << block_shift };
+
+    HiZBuffer(float* zb, int w, int h, int nlevels = 2);
+
+    float* depth() const;
+    int nlevels() const;
+    int cell_size(int level) const;
+
+    void reset();
+    void mark_dirty(int bx, int by);
+
+    // True when no pixel in the rectangle (pixels, inclusive) or block can
+    // pass a depth test against a fragment depth of at most zmax.
+    bool reject_rect(int x0, int y0, int x1, int y1, float zmax);
+    bool reject_block(int bx, int by, float zmax);
+
+    void add_stats(long long tris_tested, long long tris_culled,
+        long long blocks_tested, long long blocks_culled);
+    void reset_stats();
+
+    std::atomic<long long> triangles_tested;
+    std::atomic<long long> triangles_culled;
+    std::atomic<long long> blocks_tested;
+    std::atomic<long long> blocks_culled;
+
+private:
+    struct Level {
+        int shift;
+        int nx, ny;
+        std::vector<float> zmin;
+        std::vector<unsigned char> dirty;
+    };
+
+    float cell_min(int level, int cx, int cy);
+    void refresh(int level, int cx, int cy);
+
+private:
+    float* zb_;
+    int width_;
+    int height_;
+    std::vector<Level> levels_;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "image_writer.h"
+#include "profiler.h"
+
+ImageWriter::ImageWriter(int depth, int encode_threads)
+    : depth_(std::max(0, depth)), encode_threads_(encode_threads), mutex_(), work_(), space_(), idle_(),
+    queue_(), spare_(), busy_(false), stop_(false), failed_(false), stall_ms_(0.0), thread_()
+{
+    for (int i = 0; i < depth_; i++) spare_.emplace_back(new TGAImage());
+    if (depth_ > 0) thread_ = std::thread(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter() {
+    if (depth_ == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+}
+
+int ImageWriter::depth() const { return depth_; }
+
+double ImageWriter::stall_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stall_ms_;
+}
+
+bool ImageWriter::write(TGAImage& image, const std::string& path) {
+    PROFILE_ZONE("tga_write");
+    image.flip_vertically();
+    bool ok = image.write_tga_file(path.c_str(), true, encode_threads_);
+    if (!ok) std::cerr << "Cannot write " << path << "\n";
+    return ok;
+}
+
+void ImageWriter::submit(TGAImage& image, const std::string& path, const Done& done) {
+    if (depth_ == 0) {
+        bool ok = write(image, path);
+        if (!ok) failed_ = true;
+        if (done) done(ok);
+        return;
+    }
+
+    std::unique_ptr<TGAImage> buffer;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (spare_.empty()) {
+            auto t0 = std::chrono::steady_clock::now();
+            space_.wait(lock, [this] { return !spare_.empty(); });
+            stall_ms_ += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        buffer = std::move(spare_.back());
+        spare_.pop_back();
+    }
+
+    int w = image.get_width(), h = image.get_height(), bpp = image.get_bytespp();
+    buffer->swap(image);
+    if (image.get_width() != w || image.get_height() != h || image.get_bytespp() != bpp) image = TGAImage(w, h, bpp);
+
+    Item item;
+    item.image = std::move(buffer);
+    item.path = path;
+    item.done = done;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(item));
+    }
+    work_.notify_one();
+}
+
+void ImageWriter::post(const std::function<void()>& fn) {
+    if (depth_ == 0) {
+        fn();
+        return;
+    }
+
+    Item item;
+    item.done = [fn](bool) { fn(); };
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(item));
+    }
+    work_.notify_one();
+}
+
+bool ImageWriter::finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    bool ok = !failed_;
+    failed_ = false;
+    return ok;
+}
+
+void ImageWriter::run() {
+    for (;;) {
+        Item item;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            // stop_ only ends the thread once the queue has drained.
+            if (queue_.empty()) return;
+            item = std::move(queue_.front());
+            queue_.pop_front();
+            busy_ = true;
+        }
+
+        bool ok = true;
+        if (item.image) ok = write(*item.image, item.path);
+        if (item.done) item.done(ok);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (item.image) spare_.push_back(std::move(item.image));
+            if (!ok) failed_ = true;
+            busy_ = false;
+        }
+        space_.notify_one();
+        idle_.notify_all();
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef __IMAGE_WRITER_H__
+#define __IMAGE_WRITER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tgaimage.h"
+
+// Writes finished frames on a background thread, so the next frame renders
+// while the last one is flipped, encoded and written.
+//
+// The writer owns depth spare colour buffers. submit() swaps the caller's
+// framebuffer with a spare one instead of copying it, which makes the
+// renderer's target double-buffered at depth 1 and triple-buffered at
+// depth 2. When all spares are queued the disk is behind, and submit()
+// blocks until one is written (backpressure). Depth 0 writes on the
+// calling thread, as if there were no writer.
+//
+// Work runs strictly in submission order, one item at a time.
+class ImageWriter {
+public:
+    typedef std::function<void(bool ok)> Done;
+
+    // encode_threads is passed to the RLE encoder; leaving the cores to
+    // the renderer is usually faster overall.
+    explicit ImageWriter(int depth = 2, int encode_threads = 1);
+    // Waits for everything queued.
+    ~ImageWriter();
+
+    // Queues image, bottom-up as rendered, for writing to path. image gets
+    // a buffer of the same size in exchange, with undefined contents. done
+    // runs on the writer thread once the file is written or has failed.
+    void submit(TGAImage& image, const std::string& path, const Done& done = Done());
+    // Runs fn on the writer thread after everything submitted before it.
+    void post(const std::function<void()>& fn);
+
+    // Waits until the queue is empty. False when a write has failed since
+    // the last call.
+    bool finish();
+
+    int depth() const;
+    // Total time submit() spent waiting for a free buffer.
+    double stall_ms() const;
+
+private:
+    struct Item {
+        std::unique_ptr<TGAImage> image;
+        std::string path;
+        Done done;
+    };
+
+    void run();
+    bool write(TGAImage& image, const std::string& path);
+
+private:
+    int depth_;
+    int encode_threads_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable space_;
+    std::condition_variable idle_;
+    std::deque<Item> queue_;
+    std::vector<std::unique_ptr<TGAImage>> spare_;
+    bool busy_;
+    bool stop_;
+    bool failed_;
+    double stall_ms_;
+    std::thread thread_;
+};
+
+#endif
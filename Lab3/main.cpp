@@ -1,147 +1,143 @@
-﻿#include <vector>
-#include <cmath>
-#include <iostream>
+﻿#include <iostream>
 #include <algorithm>
-#include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <string>
 
 #include "graphics.h"
-#include "tgaimage.h"
 #include "model.h"
-#include "geometry.h"
-
-Vec3f light_dir(0, 0, -1);
-Vec3f camera(1, 0, 4);
-Vec3f center(0, 0, 0);
-Vec3f up(0, 1, 0);
-
-float s = 0.95f;
-
-Vec3f C[8] = {
-  {-s,-s,-s}, { s,-s,-s}, { s, s,-s}, {-s, s,-s},
-  {-s,-s, s}, { s,-s, s}, { s, s, s}, {-s, s, s}
-};
-
-int F[12][3] = {
-  {0,1,2},{0,2,3},
-  {4,6,5},{4,7,6},
-  {0,4,5},{0,5,1},
-  {3,2,6},{3,6,7},
-  {0,3,7},{0,7,4},
-  {1,5,6},{1,6,2} 
-};
-
-
-static Vec3f m2v(Matrix m) {
-    return Vec3f(
-        m[0][0] / m[3][0],
-        m[1][0] / m[3][0],
-        m[2][0] / m[3][0]
-    );
-}
-
-static Matrix v2m(Vec3f v) {
-    Matrix m(4, 1);
-    m[0][0] = v.x;
-    m[1][0] = v.y;
-    m[2][0] = v.z;
-    m[3][0] = 1.f;
-    return m;
+#include "shade_simd.h"
+#include "renderer.h"
+#include "server.h"
+#include "profiler.h"
+
+// Writes PREFIX.json and PREFIX.trace.json.
+static bool write_profile(const std::string& prefix) {
+    bool ok = write_profile_json((prefix + ".json").c_str());
+    ok = write_profile_trace((prefix + ".trace.json").c_str()) && ok;
+    if (ok) std::cerr << "profile written to " << prefix << ".json and " << prefix << ".trace.json\n";
+    return ok;
 }
 
 int main(int argc, char** argv) {
-    if (argc == 2) model = new Model(argv[1]);
-    else          model = new Model("obj/african_head.obj");
-
-    if (!model || model->nverts() == 0 || model->nfaces() == 0) {
-        std::cerr << "Model is empty or failed to load\n";
-        delete model;
-        return 1;
-    }
-
-    light_dir.normalize();
-
-    zbuffer = new float[width * height];
-    for (int i = 0; i < width * height; i++) {
-        zbuffer[i] = -std::numeric_limits<float>::infinity();
-    }
-
-    Viewport = viewport(0, 0, width, height);
-
-
-    lookat(camera, center, up);
-
-    Projection = Matrix::identity(4);
-    Vec3f dir = camera - center;
-    float dist = dir.norm();
-    if (dist == 0.f) dist = 1.f;
-    Projection[3][2] = -1.f / dist;
-
-    TGAImage image(width, height, TGAImage::RGB);
-
-    bool use_tex = model->has_diffuse();
-
-    for (int i = 0; i < model->nfaces(); i++) {
-        const std::vector<int>& face = model->face(i);
-        int n = (int)face.size();
-        if (n < 3) continue;
-
-        bool face_uv = use_tex && model->face_has_uv(i);
-
-        for (int k = 1; k + 1 < n; k++) {
-            int i0 = face[0];
-            int i1 = face[k];
-            int i2 = face[k + 1];
-
-            Vec3f world[3];
-            world[0] = model->vert(i0);
-            world[1] = model->vert(i1);
-            world[2] = model->vert(i2);
-
-            Vec3f pts[3];
-            for (int j = 0; j < 3; j++) {
-                Matrix v = v2m(world[j]);
-                Matrix vp = Viewport * Projection * ModelView * v;
-                pts[j] = m2v(vp);
+    RenderJob job;
+    RenderOptions options;
+    bool serve_stdin = false;
+    const char* socket_path = nullptr;
+    NormalWeighting normals = NORMALS_AREA;
+    bool quantize = false;
+    bool mesh_cache = false;
+    const char* profile_prefix = nullptr;
+    int write_queue = 2;
+
+    for (int i = 1; i < argc; i++) {
+        if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--threads")) && i + 1 < argc) {
+            options.nthreads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--deferred")) {
+            options.deferred = true;
+        }
+        else if (!strcmp(argv[i], "--no-hiz")) {
+            options.use_hiz = false;
+        }
+        else if (!strcmp(argv[i], "--cull") && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (!strcmp(mode, "none")) options.cull = CULL_NONE;
+            else if (!strcmp(mode, "ccw")) options.cull = CULL_CCW;
+            else if (!strcmp(mode, "cw")) options.cull = CULL_CW;
+            else {
+                std::cerr << "Unknown --cull mode " << mode << " (cw, ccw or none)\n";
+                return 2;
             }
-
-            Vec3f wpos[3] = { world[0], world[1], world[2] };
-            Vec3f norms[3] = { model->normal(i0), model->normal(i1), model->normal(i2) };
-
-            if (face_uv) {
-                Vec2f uvs[3];
-                uvs[0] = model->uv(i, 0);
-                uvs[1] = model->uv(i, k);
-                uvs[2] = model->uv(i, k + 1);
-
-                triangle_phong_tex(pts, uvs, norms, wpos, image, zbuffer, light_dir, camera);
+        }
+        else if (!strcmp(argv[i], "--simd") && i + 1 < argc) {
+            const char* level = argv[++i];
+            if (!strcmp(level, "scalar")) set_simd_level(SIMD_SCALAR);
+            else if (!strcmp(level, "sse4")) set_simd_level(SIMD_SSE4);
+            else if (!strcmp(level, "avx2")) set_simd_level(SIMD_AVX2);
+            else {
+                std::cerr << "Unknown --simd level " << level << " (scalar, sse4 or avx2)\n";
+                return 2;
             }
+        }
+        else if (!strcmp(argv[i], "--vcache") && i + 1 < argc) {
+            options.vertex_cache = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--normals") && i + 1 < argc) {
+            const char* weighting = argv[++i];
+            if (!strcmp(weighting, "area")) normals = NORMALS_AREA;
+            else if (!strcmp(weighting, "angle")) normals = NORMALS_ANGLE;
+            else {
+                std::cerr << "Unknown --normals weighting " << weighting << " (area or angle)\n";
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            const char* filter = argv[++i];
+            if (!strcmp(filter, "bilinear")) options.filter = TEX_BILINEAR;
+            else if (!strcmp(filter, "trilinear")) options.filter = TEX_TRILINEAR;
+            else if (!strcmp(filter, "point")) options.filter = TEX_POINT;
             else {
-                triangle_phong_flat(pts, norms, wpos, image, zbuffer, light_dir, camera, TGAColor(180, 180, 180, 255));
+                std::cerr << "Unknown --filter " << filter << " (point, bilinear or trilinear)\n";
+                return 2;
             }
         }
+        else if (!strcmp(argv[i], "--quantize")) {
+            quantize = true;
+        }
+        else if (!strcmp(argv[i], "--mesh-cache")) {
+            mesh_cache = true;
+        }
+        else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            profile_prefix = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--write-queue") && i + 1 < argc) {
+            write_queue = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--serve")) {
+            serve_stdin = true;
+        }
+        else if (!strcmp(argv[i], "--socket") && i + 1 < argc) {
+            socket_path = argv[++i];
+        }
+        else {
+            job.model_path = argv[i];
+        }
     }
 
-    TGAColor glass(180, 220, 255, 255);
-    float alpha = 0.15f;
+    if (profile_prefix) set_profiling(true);
 
-    for (int t = 0; t < 12; t++) {
-        Vec3f pts[3];
-        for (int k = 0; k < 3; k++) {
-            Vec3f v = C[F[t][k]];
-            Vec3f sv = m2v((Viewport * Projection * ModelView) * v2m(v));
-            pts[k] = sv;
-        }
-        triangle_alpha(pts, image, glass, alpha, zbuffer);
+    if (serve_stdin || socket_path) {
+        RenderServer server(options, quantize, mesh_cache, write_queue, normals);
+        int status = socket_path ? server.serve_socket(socket_path) : server.serve(std::cin, std::cout);
+        if (profile_prefix) write_profile(profile_prefix);
+        return status;
     }
 
+    Model m(job.model_path.c_str(), 0, mesh_cache, quantize);
+    if (normals != NORMALS_AREA) m.recompute_normals(normals);
+
+    FrameRenderer renderer;
+    renderer.set_options(options);
+    bool ok = renderer.render(m, job);
+    if (profile_prefix) write_profile(profile_prefix);
+    if (!ok) return 1;
+
+    const PrimitiveStats& ps = renderer.primitive_stats();
+    std::cout << "primitives: " << ps.emitted << "/" << ps.submitted << " drawn, "
+        << ps.backface << " back-facing, " << ps.frustum << " outside, "
+        << ps.degenerate << " degenerate, " << ps.clipped << " clipped\n";
 
-    image.flip_vertically();
-    image.write_tga_file("output.tga");
+    if (const HiZBuffer* h = renderer.hiz_buffer()) {
+        std::cout << "hiz: culled " << h->triangles_culled << "/" << h->triangles_tested << " triangles, "
+            << h->blocks_culled << "/" << h->blocks_tested << " blocks\n";
+    }
 
-    delete[] zbuffer;
-    delete model;
-    model = nullptr;
-    zbuffer = nullptr;
+    if (const PostTransformCache* vc = renderer.vertex_cache()) {
+        long long refs = vc->hits + vc->misses;
+        std::cout << "vertex cache: " << vc->misses << "/" << refs << " misses, acmr "
+            << (refs ? 3.0 * vc->misses / refs : 0.0) << "\n";
+    }
 
     return 0;
-}
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+
+// Modification time of a file in seconds, or -1 when it cannot be read.
+long long file_mtime(const std::string& path);
+
+// Read-only view of a whole file mapped into memory. The bytes are not
+// NUL-terminated; parsers must stop at end().
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char* filename);
+    void close();
+
+    bool is_open() const;
+    const char* data() const;
+    const char* end() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+private:
+    const char* data_;
+    size_t size_;
+    bool open_;
+#ifdef _WIN32
+    void* file_;
+    void* mapping_;
+#endif
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "mesh_adjacency.h"
+
+VertexFaceAdjacency::VertexFaceAdjacency() : start_(), faces_() {
+}
+
+void VertexFaceAdjacency::clear() {
+    start_.clear();
+    faces_.clear();
+}
+
+bool VertexFaceAdjacency::empty() const { return start_.empty(); }
+int VertexFaceAdjacency::nverts() const { return start_.empty() ? 0 : (int)start_.size() - 1; }
+
+IndexSpan VertexFaceAdjacency::faces(int v) const {
+    return IndexSpan(faces_.data() + start_[v], start_[v + 1] - start_[v]);
+}
+
+void VertexFaceAdjacency::build(const MeshData& mesh) {
+    int nv = mesh.nverts;
+    start_.assign(nv + 1, 0);
+
+    // last[v] is the last face counted for v, so a vertex repeated within
+    // one face is listed once.
+    std::vector<int> last(nv, -1);
+    for (int f = 0; f < mesh.nfaces; f++) {
+        for (int k = mesh.face_start[f]; k < mesh.face_start[f + 1]; k++) {
+            int v = mesh.face_idx[k];
+            if (v < 0 || v >= nv || last[v] == f) continue;
+            last[v] = f;
+            start_[v + 1]++;
+        }
+    }
+    for (int v = 0; v < nv; v++) start_[v + 1] += start_[v];
+
+    faces_.resize(start_[nv]);
+    std::vector<int> fill(start_.begin(), start_.end() - 1);
+    std::fill(last.begin(), last.end(), -1);
+    for (int f = 0; f < mesh.nfaces; f++) {
+        for (int k = mesh.face_start[f]; k < mesh.face_start[f + 1]; k++) {
+            int v = mesh.face_idx[k];
+            if (v < 0 || v >= nv || last[v] == f) continue;
+            last[v] = f;
+            faces_[fill[v]++] = f;
+        }
+    }
+}
+
+static float corner_angle(const Vec3f& p, const Vec3f& a, const Vec3f& b) {
+    Vec3f u = a - p, w = b - p;
+    float lu = u.norm(), lw = w.norm();
+    if (lu <= 0.f || lw <= 0.f) return 0.f;
+    float c = (u * w) / (lu * lw);
+    return std::acos(std::max(-1.f, std::min(1.f, c)));
+}
+
+static Vec3f gather_one(const MeshData& mesh, const VertexFaceAdjacency& adj, NormalWeighting weighting, int v) {
+    Vec3f n(0.f, 0.f, 0.f);
+    for (int f : adj.faces(v)) {
+        const int* idx = mesh.face_idx + mesh.face_start[f];
+        int cnt = mesh.face_start[f + 1] - mesh.face_start[f];
+
+        for (int k = 1; k + 1 < cnt; k++) {
+            int tri[3] = { idx[0], idx[k], idx[k + 1] };
+            if (tri[0] != v && tri[1] != v && tri[2] != v) continue;
+
+            Vec3f v0 = mesh.verts[tri[0]];
+            Vec3f v1 = mesh.verts[tri[1]];
+            Vec3f v2 = mesh.verts[tri[2]];
+            Vec3f fn = (v2 - v0) ^ (v1 - v0);
+
+            if (weighting == NORMALS_ANGLE) {
+                float len = fn.norm();
+                if (len <= 0.f) continue;
+                fn = fn * (1.f / len);
+            }
+
+            // One add per matching corner, exactly as the scatter did it.
+            for (int c = 0; c < 3; c++) {
+                if (tri[c] != v) continue;
+                if (weighting == NORMALS_ANGLE) {
+                    Vec3f p = mesh.verts[tri[c]];
+                    n = n + fn * corner_angle(p, mesh.verts[tri[(c + 1) % 3]], mesh.verts[tri[(c + 2) % 3]]);
+                }
+                else {
+                    n = n + fn;
+                }
+            }
+        }
+    }
+
+    float len = n.norm();
+    if (len > 1e-8f) return n * (1.f / len);
+    return Vec3f(0.f, 0.f, 1.f);
+}
+
+void gather_vertex_normals(const MeshData& mesh, const VertexFaceAdjacency& adj,
+    NormalWeighting weighting, Vec3f* out, int nthreads)
+{
+    int nv = mesh.nverts;
+    if (nthreads <= 0) nthreads = std::max(1, (int)std::thread::hardware_concurrency());
+    nthreads = std::max(1, std::min(nthreads, nv / 4096));
+
+    auto worker = [&](int t) {
+        int v0 = (int)((long long)nv * t / nthreads);
+        int v1 = (int)((long long)nv * (t + 1) / nthreads);
+        for (int v = v0; v < v1; v++) out[v] = gather_one(mesh, adj, weighting, v);
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < nthreads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool) th.join();
+}
@@ -0,0 +1,39 @@
+#ifndef __MESH_ADJACENCY_H__
+#define __MESH_ADJACENCY_H__
+
+#include <vector>
+#include "mesh_cache.h"
+
+// Faces around each vertex, CSR-style: faces(v) lists every face that uses
+// v once, in increasing face order. Built in two linear passes over the
+// face index array; other per-vertex gathers can reuse it.
+class VertexFaceAdjacency {
+public:
+    VertexFaceAdjacency();
+
+    void build(const MeshData& mesh);
+    void clear();
+
+    bool empty() const;
+    int nverts() const;
+    IndexSpan faces(int v) const;
+
+private:
+    std::vector<int> start_;
+    std::vector<int> faces_;
+};
+
+enum NormalWeighting {
+    NORMALS_AREA,   // each triangle counts by its area
+    NORMALS_ANGLE   // each triangle counts by its corner angle at the vertex
+};
+
+// Smooth vertex normals as a gather over the adjacency, split across
+// nthreads threads by vertex range (0 picks the core count). Polygons are
+// fanned from their first corner, as the renderer draws them. With area
+// weighting the sums are taken in the same triangle order as a serial
+// scatter, so the result does not depend on the thread count.
+void gather_vertex_normals(const MeshData& mesh, const VertexFaceAdjacency& adj,
+    NormalWeighting weighting, Vec3f* out, int nthreads = 0);
+
+#endif
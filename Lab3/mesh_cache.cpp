@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "mesh_cache.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(float), "Vec3f must be three packed floats");
+static_assert(sizeof(Vec2f) == 2 * sizeof(float), "Vec2f must be two packed floats");
+
+// Bump whenever the layout or the meaning of the stored data changes
+// (parser, normalization, normal weighting, face order or quantization).
+static const unsigned mesh_cache_version = 3;
+static const unsigned mesh_cache_endian = 0x01020304;
+static const char mesh_cache_magic[8] = { 'L', 'A', 'B', '3', 'M', 'E', 'S', 'H' };
+
+// Bytes hashed at each end of the source OBJ. Hashing all of it would cost
+// as much as the parse the cache is meant to skip.
+static const size_t source_sample_bytes = 64 * 1024;
+static const size_t section_align = 16;
+
+enum {
+    SEC_VERTS,
+    SEC_NORMS,
+    SEC_UVS,
+    SEC_FACE_IDX,
+    SEC_FACE_START,
+    SEC_UV_IDX,
+    SEC_UV_START,
+    SEC_QVERTS,
+    SEC_QNORMS,
+    SEC_QUVS,
+    SEC_COUNT
+};
+
+struct MeshCacheHeader {
+    char magic[8];
+    unsigned version;
+    unsigned endian;
+    unsigned long long header_size;
+    unsigned long long file_size;
+
+    unsigned long long source_size;
+    long long source_mtime;
+    unsigned long long source_hash;
+    unsigned long long payload_hash;
+
+    unsigned quantized;
+    unsigned reserved;
+    // QuantBounds as pos_min, pos_step, uv_min, uv_step.
+    float bounds[10];
+
+    unsigned long long offset[SEC_COUNT];
+    unsigned long long count[SEC_COUNT];
+
+    unsigned long long header_hash;
+};
+
+MeshData::MeshData()
+    : verts(nullptr), norms(nullptr), uvs(nullptr), qverts(nullptr), qnorms(nullptr), quvs(nullptr), bounds(),
+    face_idx(nullptr), face_start(nullptr), uv_idx(nullptr), uv_start(nullptr),
+    nverts(0), nuvs(0), nfaces(0), nidx(0), nuvidx(0)
+{
+}
+
+bool MeshData::quantized() const { return qverts != nullptr; }
+
+static const size_t section_elem[SEC_COUNT] = {
+    sizeof(Vec3f), sizeof(Vec3f), sizeof(Vec2f), sizeof(int), sizeof(int), sizeof(int), sizeof(int),
+    sizeof(PackedPos), sizeof(PackedNormal), sizeof(PackedUV)
+};
+
+// Four independent multiply-rotate lanes over 8-byte words, folded at the
+// end; fast enough to check a few hundred MB on every load.
+static unsigned long long hash_bytes(const void* data, size_t n, unsigned long long seed) {
+    const unsigned long long k1 = 0x9E3779B185EBCA87ull, k2 = 0xC2B2AE3D27D4EB4Full;
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned long long h[4] = { seed + k1, seed ^ k2, seed - k1, seed + k2 + n };
+
+    auto round = [&](unsigned long long acc, unsigned long long w) {
+        acc += w * k2;
+        acc = (acc << 31) | (acc >> 33);
+        return acc * k1;
+    };
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            unsigned long long w;
+            std::memcpy(&w, p + i + 8 * l, 8);
+            h[l] = round(h[l], w);
+        }
+    }
+    unsigned long long r = h[0] ^ ((h[1] << 7) | (h[1] >> 57)) ^ ((h[2] << 12) | (h[2] >> 52)) ^ ((h[3] << 18) | (h[3] >> 46));
+    for (; i + 8 <= n; i += 8) {
+        unsigned long long w;
+        std::memcpy(&w, p + i, 8);
+        r = round(r, w);
+    }
+    for (; i < n; i++) r = round(r, p[i]);
+
+    r ^= r >> 33;
+    r *= k2;
+    r ^= r >> 29;
+    return r;
+}
+
+static bool source_identity(const char* obj_path, unsigned long long& size, long long& mtime, unsigned long long& hash) {
+    MappedFile src;
+    if (!src.open(obj_path)) return false;
+    size = src.size();
+    mtime = file_mtime(obj_path);
+
+    size_t head = std::min(src.size(), source_sample_bytes);
+    size_t tail = std::min(src.size() - head, source_sample_bytes);
+    hash = hash_bytes(src.data(), head, size);
+    hash = hash_bytes(src.end() - tail, tail, hash);
+    return true;
+}
+
+static size_t align_up(size_t n) {
+    return (n + section_align - 1) & ~(section_align - 1);
+}
+
+std::string mesh_cache_path(const char* obj_path, bool quantized) {
+    return std::string(obj_path) + (quantized ? ".q16.lab3mesh" : ".lab3mesh");
+}
+
+// A temporary name no other writer uses, in any process: concurrent loads
+// of the same OBJ each write their own file.
+static std::string temp_path(const std::string& path) {
+    static std::atomic<unsigned> counter(0);
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    std::ostringstream s;
+    s << path << "." << pid << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000
+        << "." << counter++ << "." << std::chrono::steady_clock::now().time_since_epoch().count() % 1000000 << ".tmp";
+    return s.str();
+}
+
+// Renames from to to, replacing any existing file in one step, so readers
+// see the old cache or the new one and never a missing one.
+static bool replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool write_mesh_cache(const char* obj_path, const MeshData& mesh) {
+    MeshCacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, mesh_cache_magic, sizeof(h.magic));
+    h.version = mesh_cache_version;
+    h.endian = mesh_cache_endian;
+    h.header_size = sizeof(h);
+    if (!source_identity(obj_path, h.source_size, h.source_mtime, h.source_hash)) return false;
+
+    const void* data[SEC_COUNT] = {
+        mesh.verts, mesh.norms, mesh.uvs, mesh.face_idx, mesh.face_start, mesh.uv_idx, mesh.uv_start,
+        mesh.qverts, mesh.qnorms, mesh.quvs
+    };
+    const size_t* elem = section_elem;
+    bool q = mesh.quantized();
+    h.quantized = q ? 1 : 0;
+    if (q) {
+        const QuantBounds& b = mesh.bounds;
+        float f[10] = { b.pos_min.x, b.pos_min.y, b.pos_min.z, b.pos_step.x, b.pos_step.y, b.pos_step.z,
+            b.uv_min.x, b.uv_min.y, b.uv_step.x, b.uv_step.y };
+        std::memcpy(h.bounds, f, sizeof(f));
+    }
+    h.count[q ? SEC_QVERTS : SEC_VERTS] = mesh.nverts;
+    h.count[q ? SEC_QNORMS : SEC_NORMS] = mesh.nverts;
+    h.count[q ? SEC_QUVS : SEC_UVS] = mesh.nuvs;
+    h.count[SEC_FACE_IDX] = mesh.nidx;
+    h.count[SEC_FACE_START] = mesh.nfaces + 1;
+    h.count[SEC_UV_IDX] = mesh.nuvidx;
+    h.count[SEC_UV_START] = mesh.nfaces + 1;
+
+    size_t off = align_up(sizeof(h));
+    for (int s = 0; s < SEC_COUNT; s++) {
+        h.offset[s] = off;
+        off = align_up(off + h.count[s] * elem[s]);
+    }
+    h.file_size = off;
+
+    static const char zeros[section_align] = {};
+    unsigned long long ph = h.file_size;
+    size_t pos = align_up(sizeof(h));
+    for (int s = 0; s < SEC_COUNT; s++) {
+        size_t n = (size_t)h.count[s] * elem[s];
+        ph = hash_bytes(data[s], n, ph);
+        pos += n;
+        size_t pad = align_up(pos) - pos;
+        ph = hash_bytes(zeros, pad, ph);
+        pos += pad;
+    }
+    h.payload_hash = ph;
+    h.header_hash = hash_bytes(&h, offsetof(MeshCacheHeader, header_hash), 0);
+
+    // Written under a temporary name and renamed into place, so a reader
+    // never maps a half-written file.
+    std::string path = mesh_cache_path(obj_path, q);
+    std::string tmp = temp_path(path);
+    std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    out.write((const char*)&h, sizeof(h));
+    out.write(zeros, align_up(sizeof(h)) - sizeof(h));
+    pos = align_up(sizeof(h));
+    for (int s = 0; s < SEC_COUNT; s++) {
+        size_t n = (size_t)h.count[s] * elem[s];
+        if (n) out.write((const char*)data[s], n);
+        pos += n;
+        out.write(zeros, align_up(pos) - pos);
+        pos = align_up(pos);
+    }
+    out.close();
+    if (!out) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    if (!replace_file(tmp, path)) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool map_mesh_cache(const char* obj_path, bool quantized, MappedFile& file, MeshData& mesh) {
+    std::string path = mesh_cache_path(obj_path, quantized);
+    if (!file.open(path.c_str())) return false;
+
+    MeshCacheHeader h;
+    if (file.size() < sizeof(h)) return false;
+    std::memcpy(&h, file.data(), sizeof(h));
+
+    if (std::memcmp(h.magic, mesh_cache_magic, sizeof(h.magic)) != 0) return false;
+    if (h.version != mesh_cache_version || h.endian != mesh_cache_endian || h.header_size != sizeof(h)) return false;
+    if (h.header_hash != hash_bytes(&h, offsetof(MeshCacheHeader, header_hash), 0)) return false;
+    if (h.file_size != file.size()) return false;
+    if (h.quantized != (quantized ? 1u : 0u)) return false;
+
+    unsigned long long size, hash;
+    long long mtime;
+    if (!source_identity(obj_path, size, mtime, hash)) return false;
+    if (size != h.source_size || mtime != h.source_mtime || hash != h.source_hash) return false;
+
+    const size_t* elem = section_elem;
+    for (int s = 0; s < SEC_COUNT; s++) {
+        if (h.count[s] > 0x7fffffffull) return false;
+        if (h.offset[s] % section_align != 0) return false;
+        if (h.offset[s] > h.file_size || h.count[s] * elem[s] > h.file_size - h.offset[s]) return false;
+    }
+    if (h.count[SEC_NORMS] != h.count[SEC_VERTS] || h.count[SEC_QNORMS] != h.count[SEC_QVERTS]) return false;
+    if (quantized ? (h.count[SEC_VERTS] || h.count[SEC_UVS]) : (h.count[SEC_QVERTS] || h.count[SEC_QUVS])) return false;
+    if (h.count[SEC_FACE_START] == 0 || h.count[SEC_UV_START] != h.count[SEC_FACE_START]) return false;
+
+    const char* base = file.data();
+    unsigned long long ph = h.file_size;
+    for (int s = 0; s < SEC_COUNT; s++) {
+        size_t n = (size_t)h.count[s] * elem[s];
+        size_t pad = align_up((size_t)h.offset[s] + n) - ((size_t)h.offset[s] + n);
+        if (h.offset[s] + n + pad > h.file_size) return false;
+        ph = hash_bytes(base + h.offset[s], n, ph);
+        ph = hash_bytes(base + h.offset[s] + n, pad, ph);
+    }
+    if (h.payload_hash != ph) return false;
+
+    mesh.verts = (const Vec3f*)(base + h.offset[SEC_VERTS]);
+    mesh.norms = (const Vec3f*)(base + h.offset[SEC_NORMS]);
+    mesh.uvs = (const Vec2f*)(base + h.offset[SEC_UVS]);
+    mesh.face_idx = (const int*)(base + h.offset[SEC_FACE_IDX]);
+    mesh.face_start = (const int*)(base + h.offset[SEC_FACE_START]);
+    mesh.uv_idx = (const int*)(base + h.offset[SEC_UV_IDX]);
+    mesh.uv_start = (const int*)(base + h.offset[SEC_UV_START]);
+    if (quantized) {
+        mesh.verts = nullptr;
+        mesh.norms = nullptr;
+        mesh.uvs = nullptr;
+        mesh.qverts = (const PackedPos*)(base + h.offset[SEC_QVERTS]);
+        mesh.qnorms = (const PackedNormal*)(base + h.offset[SEC_QNORMS]);
+        mesh.quvs = (const PackedUV*)(base + h.offset[SEC_QUVS]);
+        const float* f = h.bounds;
+        mesh.bounds.pos_min = Vec3f(f[0], f[1], f[2]);
+        mesh.bounds.pos_step = Vec3f(f[3], f[4], f[5]);
+        mesh.bounds.uv_min = Vec2f(f[6], f[7]);
+        mesh.bounds.uv_step = Vec2f(f[8], f[9]);
+    }
+    mesh.nverts = (int)h.count[quantized ? SEC_QVERTS : SEC_VERTS];
+    mesh.nuvs = (int)h.count[quantized ? SEC_QUVS : SEC_UVS];
+    mesh.nfaces = (int)h.count[SEC_FACE_START] - 1;
+    mesh.nidx = (int)h.count[SEC_FACE_IDX];
+    mesh.nuvidx = (int)h.count[SEC_UV_IDX];
+
+    // Cheap structural checks the hash cannot vouch for if the writer was
+    // buggy: offsets must end where the index arrays do.
+    if (mesh.face_start[0] != 0 || mesh.face_start[mesh.nfaces] != mesh.nidx) return false;
+    if (mesh.uv_start[0] != 0 || mesh.uv_start[mesh.nfaces] != mesh.nuvidx) return false;
+    return true;
+}
+
+bool open_mesh_cache(const char* obj_path, bool quantized, MappedFile& file, MeshData& mesh) {
+    if (map_mesh_cache(obj_path, quantized, file, mesh)) return true;
+    file.close();
+    mesh = MeshData();
+    return false;
+}
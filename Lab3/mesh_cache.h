@@ -0,0 +1,69 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include <string>
+#include "geometry.h"
+#include "mapped_file.h"
+#include "quantize.h"
+
+// Read-only view of a run of ints owned by someone else.
+class IndexSpan {
+public:
+    IndexSpan() : data_(nullptr), size_(0) {}
+    IndexSpan(const int* data, int size) : data_(data), size_(size) {}
+
+    const int* begin() const { return data_; }
+    const int* end() const { return data_ + size_; }
+    const int* data() const { return data_; }
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    int operator[](int i) const { return data_[i]; }
+
+private:
+    const int* data_;
+    int size_;
+};
+
+// Views of everything Model needs to render, wherever it lives: in the
+// Model's own vectors after a parse, or straight inside a mapped cache file.
+// A quantized mesh has qverts/qnorms/quvs and bounds set and verts, norms
+// and uvs null; otherwise it is the other way round.
+struct MeshData {
+    const Vec3f* verts;
+    const Vec3f* norms;
+    const Vec2f* uvs;
+    const PackedPos* qverts;
+    const PackedNormal* qnorms;
+    const PackedUV* quvs;
+    QuantBounds bounds;
+    const int* face_idx;
+    const int* face_start;
+    const int* uv_idx;
+    const int* uv_start;
+
+    int nverts;
+    int nuvs;
+    int nfaces;
+    int nidx;
+    int nuvidx;
+
+    MeshData();
+    bool quantized() const;
+};
+
+// A .lab3mesh file sits next to its OBJ and holds the parsed, normalized
+// mesh with its vertex normals, laid out so that mapping it is all a load
+// has to do. The header records a format version, the size, mtime and a
+// sampled hash of the source OBJ, a hash of the payload and a hash of
+// itself; any mismatch makes the cache stale and it is rebuilt. Float and
+// quantized meshes are cached under different names (.lab3mesh and
+// .q16.lab3mesh), so loads in both modes do not keep replacing each other.
+std::string mesh_cache_path(const char* obj_path, bool quantized);
+
+bool write_mesh_cache(const char* obj_path, const MeshData& mesh);
+
+// Maps and validates the cache for obj_path. On success mesh points into
+// file, which must stay open for as long as mesh is used.
+bool open_mesh_cache(const char* obj_path, bool quantized, MappedFile& file, MeshData& mesh);
+
+#endif
@@ -1,159 +1,321 @@
 #include "model.h"
+#include "mapped_file.h"
+#include "obj_parse.h"
+#include "mesh_cache.h"
+#include "vertex_cache.h"
+#include "profiler.h"
 #include <iostream>
-#include <fstream>
+#include <cstring>
 #include <string>
 #include <limits>
 #include <algorithm>
 #include <cstdlib>
+#include <functional>
+#include <thread>
+
+// Records parsed from one newline-aligned slice of the file. Faces are kept
+// flat; relative (negative) indices are resolved against the chunk's own
+// counts, and their positions are remembered so that the merge can shift
+// them by the number of vertices and uvs in earlier chunks.
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uvs;
+
+    std::vector<int> face_start;
+    std::vector<int> face_idx;
+    std::vector<int> uv_start;
+    std::vector<int> uv_idx;
+    std::vector<size_t> rel_idx;
+    std::vector<size_t> rel_uv;
+
+    size_t vCount;
+    size_t fCount;
+};
+
+// Below this many bytes per chunk the threads cost more than they save.
+static const size_t min_chunk_bytes = 1 << 20;
+
+static void parse_obj_chunk(ObjChunk& c) {
+    c.vCount = 0;
+    c.fCount = 0;
+
+    const char* p = c.begin;
+    const char* end = c.end;
+    while (p < end) {
+        const char* e = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!e) e = end;
+        const char* line = p;
+        p = e + 1;
+        if (e - line < 2) continue;
+
+        if (line[0] == 'v' && line[1] == ' ') {
+            float x, y, z;
+            const char* s = line + 2;
+            s = parse_float(s, e, x);
+            s = parse_float(s, e, y);
+            parse_float(s, e, z);
+
+            c.verts.push_back(Vec3f(x, y, z));
+            c.vCount++;
+        }
+        else if (line[0] == 'v' && line[1] == 't' && e - line >= 3 && line[2] == ' ') {
+            float u, v;
+            const char* s = line + 3;
+            s = parse_float(s, e, u);
+            parse_float(s, e, v);
 
-Model::Model(const char* filename)
-    : verts_(), faces_(), uvs_(), faces_uv_(), vnorms_(), diffusemap_()
-{
-    std::ifstream in1(filename);
-    if (!in1.is_open()) {
-        std::cerr << "Cannot open file: " << filename << std::endl;
-        return;
-    }
+            c.uvs.push_back(Vec2f(u, v));
+        }
+        else if (line[0] == 'f' && line[1] == ' ') {
+            const char* s = line + 2;
+            size_t f0 = c.face_idx.size(), uv0 = c.uv_idx.size();
+            size_t r0 = c.rel_idx.size(), ruv0 = c.rel_uv.size();
+            c.fCount++;
+
+            while (s < e) {
+                while (s < e && is_blank(*s)) s++;
+                if (s >= e) break;
+
+                long vIdx;
+                const char* q = parse_int(s, e, vIdx);
+                if (q == s) break;
+                if (vIdx < 0) {
+                    c.rel_idx.push_back(c.face_idx.size());
+                    c.face_idx.push_back((int)c.verts.size() + (int)vIdx);
+                }
+                else {
+                    c.face_idx.push_back((int)vIdx - 1);
+                }
 
-    size_t vCount = 0;
-    size_t fCount = 0;
-    size_t vtCount = 0;
-    std::string line;
+                if (q < e && *q == '/') {
+                    s = q + 1;
+                    long tmp;
+                    const char* q2 = parse_int(s, e, tmp);
+                    if (q2 != s) {
+                        if (tmp < 0) {
+                            c.rel_uv.push_back(c.uv_idx.size());
+                            c.uv_idx.push_back((int)c.uvs.size() + (int)tmp);
+                        }
+                        else if (tmp > 0) {
+                            c.uv_idx.push_back((int)tmp - 1);
+                        }
+                        s = q2;
+                    }
+                    else {
+                        s = q;
+                    }
+                }
+                else {
+                    s = q;
+                }
+                while (s < e && !is_blank(*s)) s++;
+            }
 
-    while (std::getline(in1, line)) {
-        if (line.size() < 2) continue;
-        if (!line.compare(0, 2, "v ")) vCount++;
-        else if (!line.compare(0, 2, "f ")) fCount++;
-        else if (!line.compare(0, 3, "vt ")) vtCount++;
+            if (c.face_idx.size() - f0 >= 3) {
+                c.face_start.push_back((int)f0);
+                c.uv_start.push_back((int)uv0);
+            }
+            else {
+                c.face_idx.resize(f0);
+                c.uv_idx.resize(uv0);
+                c.rel_idx.resize(r0);
+                c.rel_uv.resize(ruv0);
+            }
+        }
     }
+}
 
-    in1.close();
-    verts_.reserve(vCount);
-    faces_.reserve(fCount);
-    uvs_.reserve(vtCount);
-    faces_uv_.reserve(fCount);
+Model::Model(const char* filename, int nthreads, bool use_cache, bool quantize)
+    : verts_(), face_idx_(), face_start_(1, 0), uvs_(), uv_idx_(), uv_start_(1, 0), vnorms_(),
+    qverts_(), qnorms_(), quvs_(), mesh_(), cache_(), adjacency_(), nthreads_(nthreads), diffusemap_(), diffuse_tex_(), diffuse_tex_mutex_()
+{
+    bind_mesh();
+    if (!load_mesh(filename, nthreads, use_cache, quantize)) return;
+    // Timed by its own "texture_load" zone.
+    load_texture(std::string(filename), "_diffuse.tga", diffusemap_);
+}
 
-    std::ifstream in2(filename);
-    if (!in2.is_open()) {
-        std::cerr << "Cannot open file on second pass: " << filename << std::endl;
-        return;
+bool Model::load_mesh(const char* filename, int nthreads, bool use_cache, bool quantize) {
+    if (use_cache) {
+        PROFILE_ZONE("mesh_cache_load");
+        if (open_mesh_cache(filename, quantize, cache_, mesh_)) {
+            std::cerr << "mesh cache " << mesh_cache_path(filename, quantize) << " v: " << mesh_.nverts << " f: " << mesh_.nfaces << "\n";
+            return true;
+        }
     }
 
-    while (std::getline(in2, line)) {
-        if (line.size() < 2) continue;
+    ProfileZone zone("obj_load");
+    if (!parse_obj(filename, nthreads)) return false;
+    bind_mesh();
 
-        if (!line.compare(0, 2, "v ")) {
-            const char* s = line.c_str() + 2;
-            char* end = nullptr;
+    if (!verts_.empty()) normalize();
 
-            float x = std::strtof(s, &end); s = end;
-            float y = std::strtof(s, &end); s = end;
-            float z = std::strtof(s, &end);
+    zone.switch_to("normals");
+    compute_vertex_normals(NORMALS_AREA);
+    zone.switch_to("face_reorder");
+    reorder_faces();
+    if (quantize) pack_vertices();
 
-            verts_.push_back(Vec3f(x, y, z));
+    if (use_cache) {
+        zone.switch_to("mesh_cache_write");
+        if (!write_mesh_cache(filename, mesh_)) {
+            std::cerr << "cannot write mesh cache " << mesh_cache_path(filename, quantize) << "\n";
         }
-        else if (!line.compare(0, 3, "vt ")) {
-            const char* s = line.c_str() + 3;
-            char* end = nullptr;
+    }
+    return true;
+}
 
-            float u = std::strtof(s, &end); s = end;
-            float v = std::strtof(s, &end);
+void Model::bind_mesh() {
+    bool q = !qverts_.empty();
+    mesh_.verts = q ? nullptr : verts_.data();
+    mesh_.norms = q ? nullptr : vnorms_.data();
+    mesh_.uvs = q ? nullptr : uvs_.data();
+    mesh_.qverts = q ? qverts_.data() : nullptr;
+    mesh_.qnorms = q ? qnorms_.data() : nullptr;
+    mesh_.quvs = q ? quvs_.data() : nullptr;
+    mesh_.face_idx = face_idx_.data();
+    mesh_.face_start = face_start_.data();
+    mesh_.uv_idx = uv_idx_.data();
+    mesh_.uv_start = uv_start_.data();
+    mesh_.nverts = (int)(q ? qverts_.size() : verts_.size());
+    mesh_.nuvs = (int)(q ? quvs_.size() : uvs_.size());
+    mesh_.nfaces = (int)face_start_.size() - 1;
+    mesh_.nidx = (int)face_idx_.size();
+    mesh_.nuvidx = (int)uv_idx_.size();
+}
 
-            uvs_.push_back(Vec2f(u, v));
-        }
-        else if (!line.compare(0, 2, "f ")) {
-            const char* s = line.c_str() + 2;
-            std::vector<int> f;
-            std::vector<int> fuv;
-
-            while (*s) {
-                while (*s == ' ' || *s == '\t') s++;
-                if (!*s) break;
-
-                char* end = nullptr;
-                long vIdx = std::strtol(s, &end, 10);
-                if (s == end) break;
-                f.push_back((int)vIdx - 1);
-                int vtIdx = -1;
-
-                if (*end == '/') {
-                    s = end + 1;
-                    char* end2 = nullptr;
-
-                    long tmp = std::strtol(s, &end2, 10);
-                    if (s != end2) {
-                        vtIdx = (int)tmp - 1;
-                        s = end2;
-
-                        while (*s && *s != ' ' && *s != '\t') s++;
-                    }
-                    else {
-                        s = end;
-                        while (*s && *s != ' ' && *s != '\t') s++;
-                    }
-                }
-                else {
-                    s = end;
-                    while (*s && *s != ' ' && *s != '\t') s++;
-                }
+bool Model::parse_obj(const char* filename, int nthreads) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
 
-                if (vtIdx >= 0) fuv.push_back(vtIdx);
-            }
+    if (nthreads <= 0) nthreads = std::max(1, (int)std::thread::hardware_concurrency());
+    size_t nchunks = std::min((size_t)nthreads, std::max((size_t)1, file.size() / min_chunk_bytes));
 
-            if (f.size() >= 3) {
-                faces_.push_back(std::move(f));
-                if (!fuv.empty()) faces_uv_.push_back(std::move(fuv));
-                else faces_uv_.push_back(std::vector<int>());
-            }
+    std::vector<ObjChunk> chunks(nchunks);
+    const char* cut = file.data();
+    for (size_t i = 0; i < nchunks; i++) {
+        chunks[i].begin = cut;
+        if (i + 1 == nchunks) {
+            cut = file.end();
+        }
+        else {
+            cut = std::max(cut, file.data() + file.size() * (i + 1) / nchunks);
+            const char* nl = cut < file.end() ? static_cast<const char*>(std::memchr(cut, '\n', file.end() - cut)) : nullptr;
+            cut = nl ? nl + 1 : file.end();
         }
+        chunks[i].end = cut;
     }
 
-    std::cout << "v: " << vCount << " f: " << fCount << "\n";
-    in2.close();
-
-    if (!verts_.empty()) normalize();
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < nchunks; i++) pool.emplace_back(parse_obj_chunk, std::ref(chunks[i]));
+    parse_obj_chunk(chunks[0]);
+    for (auto& th : pool) th.join();
+
+    size_t vCount = 0, fCount = 0, nverts = 0, nuvs = 0, nfaces = 0, nidx = 0, nuvidx = 0;
+    for (const ObjChunk& c : chunks) {
+        vCount += c.vCount;
+        fCount += c.fCount;
+        nverts += c.verts.size();
+        nuvs += c.uvs.size();
+        nfaces += c.face_start.size();
+        nidx += c.face_idx.size();
+        nuvidx += c.uv_idx.size();
+    }
+    verts_.reserve(nverts);
+    uvs_.reserve(nuvs);
+    face_idx_.reserve(nidx);
+    uv_idx_.reserve(nuvidx);
+    face_start_.reserve(nfaces + 1);
+    uv_start_.reserve(nfaces + 1);
+
+    for (ObjChunk& c : chunks) {
+        int vbase = (int)verts_.size(), uvbase = (int)uvs_.size();
+        for (size_t k : c.rel_idx) c.face_idx[k] += vbase;
+        for (size_t k : c.rel_uv) c.uv_idx[k] += uvbase;
+
+        int fbase = (int)face_idx_.size(), uvfbase = (int)uv_idx_.size();
+        // The last entry so far already marks where this chunk's first face
+        // starts, so only the later starts and the new end are appended.
+        for (size_t i = 1; i < c.face_start.size(); i++) {
+            face_start_.push_back(fbase + c.face_start[i]);
+            uv_start_.push_back(uvfbase + c.uv_start[i]);
+        }
+        if (!c.face_start.empty()) {
+            face_start_.push_back(fbase + (int)c.face_idx.size());
+            uv_start_.push_back(uvfbase + (int)c.uv_idx.size());
+        }
 
-    compute_vertex_normals();
+        verts_.insert(verts_.end(), c.verts.begin(), c.verts.end());
+        uvs_.insert(uvs_.end(), c.uvs.begin(), c.uvs.end());
+        face_idx_.insert(face_idx_.end(), c.face_idx.begin(), c.face_idx.end());
+        uv_idx_.insert(uv_idx_.end(), c.uv_idx.begin(), c.uv_idx.end());
+    }
 
-    load_texture(std::string(filename), "_diffuse.tga", diffusemap_);
+    std::cerr << "v: " << vCount << " f: " << fCount << "\n";
+    return true;
 }
 
 Model::~Model() {}
 
-int Model::nverts() const { return (int)verts_.size(); }
-int Model::nfaces() const { return (int)faces_.size(); }
+int Model::nverts() const { return mesh_.nverts; }
+int Model::nfaces() const { return mesh_.nfaces; }
+bool Model::quantized() const { return mesh_.quantized(); }
+const MeshData& Model::mesh() const { return mesh_; }
+
+IndexSpan Model::face(int idx) const {
+    return IndexSpan(mesh_.face_idx + mesh_.face_start[idx], mesh_.face_start[idx + 1] - mesh_.face_start[idx]);
+}
 
-const std::vector<int>& Model::face(int idx) const {
-    return faces_[idx];
+IndexSpan Model::face_uvs(int idx) const {
+    return IndexSpan(mesh_.uv_idx + mesh_.uv_start[idx], mesh_.uv_start[idx + 1] - mesh_.uv_start[idx]);
 }
 
 Vec3f Model::vert(int i) const {
-    return verts_[i];
+    if (mesh_.qverts) return decode_position(mesh_.qverts[i], mesh_.bounds);
+    return mesh_.verts[i];
 }
 
 Vec2f Model::uv(int iface, int nthvert) const {
-    if (iface < 0 || iface >= (int)faces_uv_.size()) return Vec2f(0.f, 0.f);
-    if (nthvert < 0 || nthvert >= (int)faces_uv_[iface].size()) return Vec2f(0.f, 0.f);
-    int idx = faces_uv_[iface][nthvert];
-    if (idx < 0 || idx >= (int)uvs_.size()) return Vec2f(0.f, 0.f);
-    return uvs_[idx];
+    if (iface < 0 || iface >= nfaces()) return Vec2f(0.f, 0.f);
+    if (nthvert < 0 || nthvert >= mesh_.uv_start[iface + 1] - mesh_.uv_start[iface]) return Vec2f(0.f, 0.f);
+    int idx = mesh_.uv_idx[mesh_.uv_start[iface] + nthvert];
+    if (idx < 0 || idx >= mesh_.nuvs) return Vec2f(0.f, 0.f);
+    if (mesh_.quvs) return decode_uv(mesh_.quvs[idx], mesh_.bounds);
+    return mesh_.uvs[idx];
 }
 
 bool Model::face_has_uv(int iface) const {
-    if (iface < 0 || iface >= (int)faces_uv_.size()) return false;
-    return faces_uv_[iface].size() >= 3;
+    if (iface < 0 || iface >= nfaces()) return false;
+    return mesh_.uv_start[iface + 1] - mesh_.uv_start[iface] >= 3;
+}
+
+std::string Model::texture_path(const std::string& filename, const char* suffix) {
+    size_t dot = filename.find_last_of(".");
+    if (dot == std::string::npos) return std::string();
+    return filename.substr(0, dot) + std::string(suffix);
 }
 
 void Model::load_texture(std::string filename, const char* suffix, TGAImage& img) {
-    std::string texfile(filename);
-    size_t dot = texfile.find_last_of(".");
-    if (dot != std::string::npos) {
-        texfile = texfile.substr(0, dot) + std::string(suffix);
+    PROFILE_ZONE("texture_load");
+    std::string texfile = texture_path(filename, suffix);
+    if (!texfile.empty()) {
         std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
         if (img.get_width() > 0 && img.get_height() > 0) img.flip_vertically();
     }
 }
 
+void Model::reload_diffuse(const char* filename) {
+    diffusemap_ = TGAImage();
+    diffuse_tex_.clear();
+    load_texture(std::string(filename), "_diffuse.tga", diffusemap_);
+}
+
 TGAColor Model::diffuse(Vec2i uv) {
     return diffusemap_.get(uv.x, uv.y);
 }
@@ -170,47 +332,145 @@ int Model::diffuse_height() {
     return diffusemap_.get_height();
 }
 
+int Model::diffuse_bytespp() {
+    return diffusemap_.get_bytespp();
+}
+
+unsigned char* Model::diffuse_data() {
+    return diffusemap_.buffer();
+}
+
+TGAImage& Model::diffuse_map() {
+    return diffusemap_;
+}
+
+const Texture& Model::diffuse_texture() {
+    std::lock_guard<std::mutex> lock(diffuse_tex_mutex_);
+    if (diffuse_tex_.empty() && has_diffuse()) diffuse_tex_.build(diffusemap_);
+    return diffuse_tex_;
+}
+
 Vec3f Model::normal(int vidx) const {
-    if (vidx < 0 || vidx >= (int)vnorms_.size()) return Vec3f(0.f, 0.f, 1.f);
-    return vnorms_[vidx];
+    if (vidx < 0 || vidx >= mesh_.nverts) return Vec3f(0.f, 0.f, 1.f);
+    if (mesh_.qnorms) return decode_normal(mesh_.qnorms[vidx]);
+    if (!mesh_.norms) return Vec3f(0.f, 0.f, 1.f);
+    return mesh_.norms[vidx];
 }
 
 bool Model::has_normals() const {
-    return (int)vnorms_.size() == (int)verts_.size();
+    return (mesh_.norms != nullptr || mesh_.qnorms != nullptr) && mesh_.nverts > 0;
 }
 
-void Model::compute_vertex_normals() {
-    vnorms_.assign(verts_.size(), Vec3f(0.f, 0.f, 0.f));
+const VertexFaceAdjacency& Model::adjacency() {
+    if (adjacency_.empty()) adjacency_.build(mesh_);
+    return adjacency_;
+}
 
-    for (int i = 0; i < (int)faces_.size(); i++) {
-        const std::vector<int>& f = faces_[i];
-        int n = (int)f.size();
-        if (n < 3) continue;
+void Model::recompute_normals(NormalWeighting weighting) {
+    if (mesh_.nverts == 0) return;
+    PROFILE_ZONE("normals");
+    compute_vertex_normals(weighting);
+}
 
-        Vec3f v0 = verts_[f[0]];
-        for (int k = 1; k + 1 < n; k++) {
-            int i1 = f[k];
-            int i2 = f[k + 1];
+// Writes into vnorms_ (or qnorms_) even when the rest of the mesh is mapped
+// from the cache, and points the mesh view at it.
+void Model::compute_vertex_normals(NormalWeighting weighting) {
+    MeshData src = mesh_;
+    std::vector<Vec3f> decoded;
+    if (mesh_.quantized()) {
+        decoded.resize(mesh_.nverts);
+        for (int i = 0; i < mesh_.nverts; i++) decoded[i] = vert(i);
+        src.verts = decoded.data();
+    }
 
-            Vec3f v1 = verts_[i1];
-            Vec3f v2 = verts_[i2];
+    vnorms_.resize(mesh_.nverts);
+    gather_vertex_normals(src, adjacency(), weighting, vnorms_.data(), nthreads_);
 
-            Vec3f e1 = v2 - v0;
-            Vec3f e2 = v1 - v0;
-            Vec3f fn = e1 ^ e2;
+    if (mesh_.quantized()) {
+        qnorms_.resize(mesh_.nverts);
+        for (int i = 0; i < mesh_.nverts; i++) qnorms_[i] = encode_normal(vnorms_[i]);
+        std::vector<Vec3f>().swap(vnorms_);
+        mesh_.qnorms = qnorms_.data();
+        return;
+    }
+    mesh_.norms = vnorms_.data();
+}
 
-            vnorms_[f[0]] = vnorms_[f[0]] + fn;
-            vnorms_[i1] = vnorms_[i1] + fn;
-            vnorms_[i2] = vnorms_[i2] + fn;
+void Model::pack_vertices() {
+    if (verts_.empty()) return;
 
+    Vec3f pmin = verts_[0], pmax = verts_[0];
+    for (const Vec3f& v : verts_) {
+        for (int k = 0; k < 3; k++) {
+            pmin[k] = std::min(pmin[k], v[k]);
+            pmax[k] = std::max(pmax[k], v[k]);
         }
     }
+    Vec2f tmin, tmax;
+    if (!uvs_.empty()) tmin = tmax = uvs_[0];
+    for (const Vec2f& t : uvs_) {
+        for (int k = 0; k < 2; k++) {
+            tmin[k] = std::min(tmin[k], t[k]);
+            tmax[k] = std::max(tmax[k], t[k]);
+        }
+    }
+
+    QuantBounds& b = mesh_.bounds;
+    b.pos_min = pmin;
+    b.pos_step = Vec3f(quant_step(pmin.x, pmax.x), quant_step(pmin.y, pmax.y), quant_step(pmin.z, pmax.z));
+    b.uv_min = tmin;
+    b.uv_step = Vec2f(quant_step(tmin.x, tmax.x), quant_step(tmin.y, tmax.y));
+
+    size_t before = verts_.size() * 2 * sizeof(Vec3f) + uvs_.size() * sizeof(Vec2f);
+
+    qverts_.resize(verts_.size());
+    qnorms_.resize(verts_.size());
+    quvs_.resize(uvs_.size());
+    for (size_t i = 0; i < verts_.size(); i++) {
+        qverts_[i] = encode_position(verts_[i], b);
+        qnorms_[i] = encode_normal(vnorms_[i]);
+    }
+    for (size_t i = 0; i < uvs_.size(); i++) quvs_[i] = encode_uv(uvs_[i], b);
+
+    std::vector<Vec3f>().swap(verts_);
+    std::vector<Vec3f>().swap(vnorms_);
+    std::vector<Vec2f>().swap(uvs_);
+    bind_mesh();
+
+    size_t after = qverts_.size() * (sizeof(PackedPos) + sizeof(PackedNormal)) + quvs_.size() * sizeof(PackedUV);
+    std::cerr << "quantized vertices: " << before << " -> " << after << " bytes\n";
+}
 
-    for (int i = 0; i < (int)vnorms_.size(); i++) {
-        float len = vnorms_[i].norm();
-        if (len > 1e-8f) vnorms_[i] = vnorms_[i] * (1.f / len);
-        else vnorms_[i] = Vec3f(0.f, 0.f, 1.f);
+// Runs after the normals, so their sums keep the file's face order.
+void Model::reorder_faces() {
+    VertexCacheReport before = measure_vertex_cache(mesh_);
+
+    std::vector<int> order;
+    optimize_face_order(mesh_, adjacency(), order);
+
+    std::vector<int> face_idx, face_start(1, 0), uv_idx, uv_start(1, 0);
+    face_idx.reserve(face_idx_.size());
+    face_start.reserve(face_start_.size());
+    uv_idx.reserve(uv_idx_.size());
+    uv_start.reserve(uv_start_.size());
+    for (int f : order) {
+        IndexSpan fv = face(f);
+        IndexSpan fu = face_uvs(f);
+        face_idx.insert(face_idx.end(), fv.begin(), fv.end());
+        uv_idx.insert(uv_idx.end(), fu.begin(), fu.end());
+        face_start.push_back((int)face_idx.size());
+        uv_start.push_back((int)uv_idx.size());
     }
+    face_idx_.swap(face_idx);
+    face_start_.swap(face_start);
+    uv_idx_.swap(uv_idx);
+    uv_start_.swap(uv_start);
+    bind_mesh();
+    adjacency_.clear();
+
+    VertexCacheReport after = measure_vertex_cache(mesh_);
+    std::cerr << "vertex cache: acmr " << before.acmr << " -> " << after.acmr
+        << ", atvr " << before.atvr << " -> " << after.atvr << "\n";
 }
 
 void Model::normalize() {
@@ -3,18 +3,37 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_adjacency.h"
 
+// Faces are stored CSR-style: the vertex indices of all faces back to back
+// in one array, and face i occupying [face_start_[i], face_start_[i + 1]).
+// Texture indices use a second pair of arrays laid out the same way.
 class Model {
 public:
-    Model(const char* filename);
+    // Large files are parsed in newline-aligned chunks on nthreads threads
+    // (0 picks the core count); the result does not depend on the split.
+    // Faces are reordered for vertex cache reuse after parsing. With
+    // quantize, positions, normals and uvs are kept 16-bit packed (see
+    // quantize.h for the error bounds) and the float copies are dropped.
+    // With use_cache the parsed mesh is saved next to the OBJ as .lab3mesh
+    // and later loads map that file instead of parsing (see mesh_cache.h).
+    // It is off by default, so a plain load never writes next to its input.
+    Model(const char* filename, int nthreads = 0, bool use_cache = false, bool quantize = false);
     ~Model();
 
     int nverts() const;
     int nfaces() const;
+    bool quantized() const;
+    const MeshData& mesh() const;
 
-    const std::vector<int>& face(int idx) const;
+    IndexSpan face(int idx) const;
+    IndexSpan face_uvs(int idx) const;
     Vec3f vert(int i) const;
 
     Vec2f uv(int iface, int nthvert) const;
@@ -24,26 +43,61 @@ public:
     Vec3f normal(int vidx) const;
     bool has_normals() const;
 
+    // Built on first use and kept; not safe to call from several threads
+    // until it has been built once.
+    const VertexFaceAdjacency& adjacency();
+    // Loads use area weighting; this redoes the normals with another one.
+    void recompute_normals(NormalWeighting weighting);
+
+    static std::string texture_path(const std::string& filename, const char* suffix);
     void load_texture(std::string filename, const char* suffix, TGAImage& img);
+    void reload_diffuse(const char* filename);
     TGAColor diffuse(Vec2i uv);
     bool has_diffuse();
     int diffuse_width();
     int diffuse_height();
+    int diffuse_bytespp();
+    unsigned char* diffuse_data();
+    TGAImage& diffuse_map();
+    // Mip-mapped copy of the diffuse map, built on first use; safe to call
+    // from several renderers at once.
+    const Texture& diffuse_texture();
 
 private:
+    // Mesh from the cache or the OBJ; false when the OBJ cannot be read.
+    bool load_mesh(const char* filename, int nthreads, bool use_cache, bool quantize);
+    bool parse_obj(const char* filename, int nthreads);
+    void bind_mesh();
     void normalize();
-    void compute_vertex_normals();
+    void compute_vertex_normals(NormalWeighting weighting);
+    void reorder_faces();
+    void pack_vertices();
 
 private:
     std::vector<Vec3f> verts_;
-    std::vector<std::vector<int>> faces_;
+    std::vector<int> face_idx_;
+    std::vector<int> face_start_;
 
     std::vector<Vec2f> uvs_;
-    std::vector<std::vector<int>> faces_uv_;
+    std::vector<int> uv_idx_;
+    std::vector<int> uv_start_;
 
     std::vector<Vec3f> vnorms_;
 
+    std::vector<PackedPos> qverts_;
+    std::vector<PackedNormal> qnorms_;
+    std::vector<PackedUV> quvs_;
+
+    // What the accessors read: the vectors above, or a mapped cache file.
+    MeshData mesh_;
+    MappedFile cache_;
+
+    VertexFaceAdjacency adjacency_;
+    int nthreads_;
+
     TGAImage diffusemap_;
+    Texture diffuse_tex_;
+    std::mutex diffuse_tex_mutex_;
 };
 
 #endif
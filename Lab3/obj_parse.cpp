@@ -0,0 +1,161 @@
+#include <cfloat>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#include "obj_parse.h"
+
+static const double pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// True when d sits exactly halfway between two adjacent normal floats.
+static bool float_midpoint(double d) {
+    unsigned long long bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return (bits & ((1ull << 29) - 1)) == (1ull << 28);
+}
+
+// strtof in the "C" locale, whatever setlocale() the program has made.
+#ifdef _MSC_VER
+static float strtof_c(const char* s, char** stop) {
+    static const _locale_t c_locale = _create_locale(LC_NUMERIC, "C");
+    return _strtof_l(s, stop, c_locale);
+}
+#else
+static float strtof_c(const char* s, char** stop) {
+    static const locale_t c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+    return strtof_l(s, stop, c_locale);
+}
+#endif
+
+static const char* parse_float_slow(const char* p, const char* s, const char* end, float& value) {
+    char buf[128];
+    size_t n = 0;
+    while (s + n < end && n + 1 < sizeof(buf) && !is_space(s[n])) {
+        buf[n] = s[n];
+        n++;
+    }
+    buf[n] = '\0';
+
+    char* stop = nullptr;
+    value = strtof_c(buf, &stop);
+    if (stop == buf) return p;
+    return s + (stop - buf);
+}
+
+const char* parse_float(const char* p, const char* end, float& value) {
+    value = 0.f;
+    const char* s = p;
+    while (s < end && is_space(*s)) s++;
+    const char* start = s;
+
+    bool neg = false;
+    if (s < end && (*s == '+' || *s == '-')) {
+        neg = *s == '-';
+        s++;
+    }
+
+    unsigned long long m = 0;
+    int ndigits = 0;
+    int exp10 = 0;
+    bool any = false;
+    bool inexact = false;
+
+    for (; s < end && is_digit(*s); s++) {
+        int d = *s - '0';
+        any = true;
+        if (m == 0 && d == 0) continue;
+        if (ndigits < 19) {
+            m = m * 10 + d;
+            ndigits++;
+        }
+        else {
+            exp10++;
+            if (d) inexact = true;
+        }
+    }
+    if (s < end && *s == '.') {
+        s++;
+        for (; s < end && is_digit(*s); s++) {
+            int d = *s - '0';
+            any = true;
+            if (m == 0 && d == 0) {
+                exp10--;
+                continue;
+            }
+            if (ndigits < 19) {
+                m = m * 10 + d;
+                ndigits++;
+                exp10--;
+            }
+            else if (d) {
+                inexact = true;
+            }
+        }
+    }
+    if (!any) return parse_float_slow(p, start, end, value);
+    if (s < end && (*s == 'x' || *s == 'X')) return parse_float_slow(p, start, end, value);
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* t = s + 1;
+        bool eneg = false;
+        if (t < end && (*t == '+' || *t == '-')) {
+            eneg = *t == '-';
+            t++;
+        }
+        if (t < end && is_digit(*t)) {
+            int e = 0;
+            for (; t < end && is_digit(*t); t++) {
+                if (e < 100000) e = e * 10 + (*t - '0');
+            }
+            exp10 += eneg ? -e : e;
+            s = t;
+        }
+    }
+
+    if (m == 0) {
+        value = neg ? -0.f : 0.f;
+        return s;
+    }
+    if (inexact || m >= (1ull << 53) || exp10 < -22 || exp10 > 22) return parse_float_slow(p, start, end, value);
+
+    double d = (double)m;
+    if (exp10 >= 0) d *= pow10_exact[exp10];
+    else d /= pow10_exact[-exp10];
+
+    if (d < FLT_MIN || float_midpoint(d)) return parse_float_slow(p, start, end, value);
+
+    value = (float)(neg ? -d : d);
+    return s;
+}
+
+const char* parse_int(const char* p, const char* end, long& value) {
+    value = 0;
+    const char* s = p;
+    while (s < end && is_space(*s)) s++;
+
+    bool neg = false;
+    if (s < end && (*s == '+' || *s == '-')) {
+        neg = *s == '-';
+        s++;
+    }
+    if (s >= end || !is_digit(*s)) return p;
+
+    unsigned long long limit = neg ? (unsigned long long)LONG_MAX + 1 : (unsigned long long)LONG_MAX;
+    unsigned long long v = 0;
+    for (; s < end && is_digit(*s); s++) {
+        unsigned d = *s - '0';
+        v = v > (limit - d) / 10 ? limit : v * 10 + d;
+    }
+    value = neg ? -(long)(v - 1) - 1 : (long)v;
+    return s;
+}
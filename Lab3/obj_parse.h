@@ -0,0 +1,26 @@
+#ifndef __OBJ_PARSE_H__
+#define __OBJ_PARSE_H__
+
+// Number scanners for OBJ text held in memory. They follow strtof/strtol:
+// leading whitespace is skipped, the returned pointer is one past the last
+// character used, and on failure the value is 0 and p itself is returned.
+// Unlike the C library they never read past end and never consult the
+// locale: '.' is always the decimal point.
+//
+// parse_float() produces exactly the float strtof would. Plain decimal
+// input is converted with one correctly rounded double operation; the rare
+// inputs where rounding that double to float could differ from rounding
+// the exact value (and anything with more than 19 significant digits, an
+// exponent out of range, hex or inf/nan) go through a "C" locale strtof on a copy.
+const char* parse_float(const char* p, const char* end, float& value);
+const char* parse_int(const char* p, const char* end, long& value);
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+#endif
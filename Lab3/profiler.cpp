@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "profiler.h"
+
+#ifndef LAB3_NO_PROFILER
+bool profile_enabled = false;
+#endif
+
+struct ProfileEvent {
+    const char* name;
+    int tid;
+    double begin;
+    double end;
+};
+
+static std::mutex profile_mutex;
+static std::vector<ProfileEvent> profile_events;
+static std::map<std::thread::id, int> profile_threads;
+static std::atomic<long long> profile_counters[PROF_COUNTER_COUNT];
+static std::chrono::steady_clock::time_point profile_epoch = std::chrono::steady_clock::now();
+
+const char* profile_counter_name(ProfileCounter c) {
+    switch (c) {
+    case PROF_TRIS_SUBMITTED: return "triangles_submitted";
+    case PROF_TRIS_CULLED: return "triangles_culled";
+    case PROF_TRIS_RASTERIZED: return "triangles_rasterized";
+    case PROF_TRIS_HIZ_CULLED: return "triangles_hiz_culled";
+    case PROF_PIXELS_TESTED: return "pixels_tested";
+    case PROF_DEPTH_PASSED: return "depth_passed";
+    case PROF_FRAGMENTS_SHADED: return "fragments_shaded";
+    case PROF_FRAGMENTS_BLENDED: return "fragments_blended";
+    case PROF_PIXELS_COVERED: return "pixels_covered";
+    default: return "unknown";
+    }
+}
+
+void set_profiling(bool enabled) {
+#ifndef LAB3_NO_PROFILER
+    if (enabled && !profile_enabled) profile_reset();
+    profile_enabled = enabled;
+#else
+    (void)enabled;
+#endif
+}
+
+void profile_reset() {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile_events.clear();
+    profile_threads.clear();
+    for (auto& c : profile_counters) c.store(0, std::memory_order_relaxed);
+    profile_epoch = std::chrono::steady_clock::now();
+}
+
+void profile_add(ProfileCounter c, long long n) {
+    profile_counters[c].fetch_add(n, std::memory_order_relaxed);
+}
+
+long long profile_counter(ProfileCounter c) {
+    return profile_counters[c].load(std::memory_order_relaxed);
+}
+
+double profile_now() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - profile_epoch).count();
+}
+
+void profile_record(const char* name, double begin, double end) {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    auto it = profile_threads.find(std::this_thread::get_id());
+    if (it == profile_threads.end()) {
+        it = profile_threads.insert(std::make_pair(std::this_thread::get_id(), (int)profile_threads.size())).first;
+    }
+    ProfileEvent e = { name, it->second, begin, end };
+    profile_events.push_back(e);
+}
+
+// Zone names are identifiers, but escape them anyway.
+static void write_json_string(std::ostream& out, const char* s) {
+    out << '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out << '\\';
+        out << *s;
+    }
+    out << '"';
+}
+
+static double overdraw() {
+    long long covered = profile_counter(PROF_PIXELS_COVERED);
+    long long opaque = profile_counter(PROF_FRAGMENTS_SHADED) - profile_counter(PROF_FRAGMENTS_BLENDED);
+    return covered ? (double)opaque / covered : 0.0;
+}
+
+bool write_profile_json(const char* path) {
+    struct ZoneTotals {
+        long long count;
+        double total;
+        double max;
+    };
+    std::vector<std::string> names;
+    std::map<std::string, ZoneTotals> zones;
+    {
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        for (const ProfileEvent& e : profile_events) {
+            auto it = zones.find(e.name);
+            if (it == zones.end()) {
+                names.push_back(e.name);
+                ZoneTotals z = { 0, 0.0, 0.0 };
+                it = zones.insert(std::make_pair(std::string(e.name), z)).first;
+            }
+            double d = e.end - e.begin;
+            it->second.count++;
+            it->second.total += d;
+            it->second.max = std::max(it->second.max, d);
+        }
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot open file: " << path << std::endl;
+        return false;
+    }
+
+    out << "{\n  \"zones\": {";
+    for (size_t i = 0; i < names.size(); i++) {
+        const ZoneTotals& z = zones[names[i]];
+        out << (i ? ",\n    " : "\n    ");
+        write_json_string(out, names[i].c_str());
+        out << ": { \"count\": " << z.count << ", \"total_ms\": " << z.total / 1000.0
+            << ", \"max_ms\": " << z.max / 1000.0 << " }";
+    }
+    out << "\n  },\n  \"counters\": {";
+    for (int c = 0; c < PROF_COUNTER_COUNT; c++) {
+        out << (c ? ",\n    " : "\n    ");
+        write_json_string(out, profile_counter_name((ProfileCounter)c));
+        out << ": " << profile_counter((ProfileCounter)c);
+    }
+    out << "\n  },\n  \"overdraw\": " << overdraw() << "\n}\n";
+    return (bool)out;
+}
+
+bool write_profile_trace(const char* path) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot open file: " << path << std::endl;
+        return false;
+    }
+
+    double last = 0.0;
+    out << "{\"traceEvents\":[\n";
+    {
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        for (const ProfileEvent& e : profile_events) {
+            out << "{\"name\":";
+            write_json_string(out, e.name);
+            out << ",\"cat\":\"lab3\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+                << ",\"ts\":" << e.begin << ",\"dur\":" << e.end - e.begin << "},\n";
+            last = std::max(last, e.end);
+        }
+    }
+
+    out << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":" << last << ",\"args\":{";
+    for (int c = 0; c < PROF_COUNTER_COUNT; c++) {
+        if (c) out << ",";
+        write_json_string(out, profile_counter_name((ProfileCounter)c));
+        out << ":" << profile_counter((ProfileCounter)c);
+    }
+    out << ",\"overdraw\":" << overdraw() << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+    return (bool)out;
+}
@@ -0,0 +1,86 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+// Per-stage frame profiler: named zones on a timeline, plus pipeline
+// counters. Off by default. While off, a zone costs one branch on a global
+// flag and the raster loops run their non-counting instantiations, so no
+// per-pixel work is added. Building with LAB3_NO_PROFILER compiles it out.
+//
+// Turn profiling on before loading the model, so the load stages are
+// recorded too, and do not toggle it while a frame is rendering.
+
+enum ProfileCounter {
+    PROF_TRIS_SUBMITTED,     // triangles given to the primitive stage
+    PROF_TRIS_CULLED,        // back-facing, outside the frustum or degenerate
+    PROF_TRIS_RASTERIZED,    // triangles binned after clipping
+    PROF_TRIS_HIZ_CULLED,    // triangle-tile pairs rejected by HiZ
+    PROF_PIXELS_TESTED,      // pixels inside a triangle, depth tested
+    PROF_DEPTH_PASSED,
+    PROF_FRAGMENTS_SHADED,   // colours computed and written
+    PROF_FRAGMENTS_BLENDED,  // the part of those blended over the image
+    PROF_PIXELS_COVERED,     // pixels with opaque geometry at the end of the frame
+    PROF_COUNTER_COUNT
+};
+
+const char* profile_counter_name(ProfileCounter c);
+
+#ifdef LAB3_NO_PROFILER
+inline bool profiling() { return false; }
+#else
+extern bool profile_enabled;
+inline bool profiling() { return profile_enabled; }
+#endif
+
+// Turning it on clears all zones and counters.
+void set_profiling(bool enabled);
+void profile_reset();
+
+void profile_add(ProfileCounter c, long long n);
+long long profile_counter(ProfileCounter c);
+
+// Microseconds since profiling was turned on.
+double profile_now();
+void profile_record(const char* name, double begin, double end);
+
+// Times the scope it lives in. name must outlive the profiler (a literal).
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* name) : name_(name), begin_(profiling() ? profile_now() : -1.0) {}
+    ~ProfileZone() {
+        if (begin_ >= 0.0) profile_record(name_, begin_, profile_now());
+    }
+
+    // Ends the current zone and starts the next one at the same instant.
+    void switch_to(const char* name) {
+        if (begin_ < 0.0 || name == name_) return;
+        double now = profile_now();
+        profile_record(name_, begin_, now);
+        name_ = name;
+        begin_ = now;
+    }
+
+private:
+    ProfileZone(const ProfileZone&);
+    ProfileZone& operator=(const ProfileZone&);
+
+    const char* name_;
+    double begin_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#ifdef LAB3_NO_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#endif
+
+// Summary: per zone the call count and total/max time (summed over
+// threads), every counter, and the overdraw of the opaque geometry:
+// unblended fragments shaded / pixels covered.
+bool write_profile_json(const char* path);
+// Every zone as a complete event in the Chrome trace format, for
+// chrome://tracing or Perfetto; counters are added as one counter event.
+bool write_profile_trace(const char* path);
+
+#endif
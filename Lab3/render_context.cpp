@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <limits>
+#include "render_context.h"
+
+RenderTarget::RenderTarget() : width_(0), height_(0), color_(), depth_(), hiz_(), use_hiz_(true) {
+}
+
+void RenderTarget::resize(int w, int h) {
+    if (w == width_ && h == height_) return;
+    width_ = w;
+    height_ = h;
+
+    color_ = TGAImage(w, h, TGAImage::RGB);
+    depth_.assign((size_t)w * h, 0.f);
+    hiz_.reset(new HiZBuffer(depth_.data(), w, h));
+}
+
+void RenderTarget::clear() {
+    color_.clear();
+    std::fill(depth_.begin(), depth_.end(), -std::numeric_limits<float>::infinity());
+    if (HiZBuffer* h = hiz()) {
+        h->reset();
+        h->reset_stats();
+    }
+}
+
+void RenderTarget::set_use_hiz(bool use_hiz) { use_hiz_ = use_hiz; }
+
+int RenderTarget::width() const { return width_; }
+int RenderTarget::height() const { return height_; }
+TGAImage& RenderTarget::color() { return color_; }
+float* RenderTarget::depth() { return depth_.data(); }
+HiZBuffer* RenderTarget::hiz() const { return use_hiz_ ? hiz_.get() : nullptr; }
+
+RenderContext::RenderContext()
+    : target(nullptr), model_view(Matrix::identity(4)), projection(Matrix::identity(4)), viewport(Matrix::identity(4)),
+    diffuse(nullptr), diffuse_mips(nullptr), filter(TEX_POINT)
+{
+}
+
+bool RenderContext::has_diffuse() const {
+    return diffuse && diffuse->get_width() > 0 && diffuse->get_height() > 0;
+}
@@ -0,0 +1,63 @@
+#ifndef __RENDER_CONTEXT_H__
+#define __RENDER_CONTEXT_H__
+
+#include <memory>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "hiz.h"
+#include "texture.h"
+
+struct TileRect {
+    int x0, y0, x1, y1;
+};
+
+// Colour and depth of one framebuffer, with a HiZ pyramid over the depth.
+// The buffers are only reallocated when the size changes.
+class RenderTarget {
+public:
+    RenderTarget();
+
+    void resize(int w, int h);
+    // Black colour, depth at -infinity, HiZ and its counters reset.
+    void clear();
+
+    void set_use_hiz(bool use_hiz);
+
+    int width() const;
+    int height() const;
+    TGAImage& color();
+    float* depth();
+    // Null when HiZ culling is off.
+    HiZBuffer* hiz() const;
+
+private:
+    int width_;
+    int height_;
+    TGAImage color_;
+    std::vector<float> depth_;
+    std::unique_ptr<HiZBuffer> hiz_;
+    bool use_hiz_;
+};
+
+// Everything a draw call reads besides its own triangle: the target it
+// draws into, the transforms and the textures bound for shading. Nothing
+// here is global, so any number of contexts can render at once, each on
+// its own target, at its own resolution.
+struct RenderContext {
+    RenderTarget* target;
+
+    Matrix model_view;
+    Matrix projection;
+    Matrix viewport;
+
+    // Diffuse map as loaded, and its mip chain when filtering is on.
+    TGAImage* diffuse;
+    const Texture* diffuse_mips;
+    TextureFilter filter;
+
+    RenderContext();
+    bool has_diffuse() const;
+};
+
+#endif
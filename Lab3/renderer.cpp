@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include "renderer.h"
+#include "graphics.h"
+#include "profiler.h"
+
+static const float glass_s = 0.95f;
+
+static const Vec3f glass_corners[8] = {
+  {-glass_s,-glass_s,-glass_s}, { glass_s,-glass_s,-glass_s}, { glass_s, glass_s,-glass_s}, {-glass_s, glass_s,-glass_s},
+  {-glass_s,-glass_s, glass_s}, { glass_s,-glass_s, glass_s}, { glass_s, glass_s, glass_s}, {-glass_s, glass_s, glass_s}
+};
+
+static const int glass_faces[12][3] = {
+  {0,1,2},{0,2,3},
+  {4,6,5},{4,7,6},
+  {0,4,5},{0,5,1},
+  {3,2,6},{3,6,7},
+  {0,3,7},{0,7,4},
+  {1,5,6},{1,6,2}
+};
+
+RenderJob::RenderJob()
+    : model_path("obj/african_head.obj"), output_path("output.tga"),
+    camera(1, 0, 4), center(0, 0, 0), up(0, 1, 0), light_dir(0, 0, -1),
+    width(1920), height(1920)
+{
+}
+
+RenderOptions::RenderOptions()
+    : nthreads(default_thread_count()), deferred(false), use_hiz(true), cull(CULL_CW), vertex_cache(0), filter(TEX_POINT)
+{
+}
+
+FrameRenderer::FrameRenderer()
+    : options_(), width_(0), height_(0), target_(), tiler_(), prims_(), xform_(), codes_(), vcache_()
+{
+}
+
+void FrameRenderer::set_options(const RenderOptions& options) {
+    options_ = options;
+}
+
+const RenderOptions& FrameRenderer::options() const { return options_; }
+
+TGAImage& FrameRenderer::image() { return target_.color(); }
+const PrimitiveStats& FrameRenderer::primitive_stats() const { return prims_->stats(); }
+const HiZBuffer* FrameRenderer::hiz_buffer() const { return target_.hiz(); }
+const PostTransformCache* FrameRenderer::vertex_cache() const { return options_.vertex_cache > 0 ? &vcache_ : nullptr; }
+
+// Triangle counts of the frame just drawn, and the pixels it covered.
+void FrameRenderer::profile_frame() {
+    const PrimitiveStats& ps = prims_->stats();
+    profile_add(PROF_TRIS_SUBMITTED, ps.submitted);
+    profile_add(PROF_TRIS_CULLED, ps.backface + ps.frustum + ps.degenerate);
+    profile_add(PROF_TRIS_RASTERIZED, tiler_->ntriangles());
+    if (const HiZBuffer* h = target_.hiz()) profile_add(PROF_TRIS_HIZ_CULLED, h->triangles_culled);
+
+    const float* zb = target_.depth();
+    long long covered = 0;
+    for (int i = 0; i < width_ * height_; i++) covered += zb[i] != -std::numeric_limits<float>::infinity();
+    profile_add(PROF_PIXELS_COVERED, covered);
+}
+
+void FrameRenderer::resize(int w, int h) {
+    if (w == width_ && h == height_) return;
+    width_ = w;
+    height_ = h;
+
+    target_.resize(w, h);
+    tiler_.reset(new TileRenderer(w, h));
+    prims_.reset(new PrimitiveStage(w, h));
+}
+
+bool FrameRenderer::render(Model& m, const RenderJob& job) {
+    if (job.width <= 0 || job.height <= 0) {
+        std::cerr << "Bad resolution " << job.width << "x" << job.height << "\n";
+        return false;
+    }
+    if (m.nverts() == 0 || m.nfaces() == 0) {
+        std::cerr << "Model is empty or failed to load\n";
+        return false;
+    }
+
+    PROFILE_ZONE("frame");
+    resize(job.width, job.height);
+    target_.set_use_hiz(options_.use_hiz);
+    target_.clear();
+
+    tiler_->clear();
+    tiler_->set_deferred(options_.deferred);
+    prims_->reset_stats();
+
+    Vec3f light_dir = job.light_dir;
+    light_dir.normalize();
+
+    RenderContext ctx;
+    ctx.target = &target_;
+    ctx.viewport = viewport(0, 0, width_, height_);
+    ctx.model_view = lookat(job.camera, job.center, job.up);
+
+    Vec3f dir = job.camera - job.center;
+    float dist = dir.norm();
+    if (dist == 0.f) dist = 1.f;
+    ctx.projection[3][2] = -1.f / dist;
+
+    Matrix mvp = ctx.viewport * ctx.projection * ctx.model_view;
+    xform_.set_matrix(mvp);
+
+    PrimitiveStage& prims = *prims_;
+    prims.set_cull(options_.cull);
+
+    bool use_vcache = options_.vertex_cache > 0;
+    if (use_vcache) {
+        vcache_.reset(options_.vertex_cache, (float)width_, (float)height_);
+    }
+    else {
+        PROFILE_ZONE("vertex_transform");
+        xform_.run(m);
+        codes_.resize(xform_.size());
+        for (int i = 0; i < xform_.size(); i++) {
+            codes_[i] = clip_outcode(xform_.clip(i), (float)width_, (float)height_);
+        }
+    }
+
+    bool use_tex = m.has_diffuse();
+    if (use_tex) {
+        ctx.diffuse = &m.diffuse_map();
+        ctx.filter = options_.filter;
+        if (ctx.filter != TEX_POINT) ctx.diffuse_mips = &m.diffuse_texture();
+    }
+    if (ctx.diffuse_mips) tiler_->set_lod_texture(ctx.diffuse->get_width(), ctx.diffuse->get_height());
+    else tiler_->set_lod_texture(0, 0);
+
+    // With the vertex cache on, vertices are transformed in here as well.
+    ProfileZone zone("primitive_assembly");
+    for (int i = 0; i < m.nfaces(); i++) {
+        IndexSpan face = m.face(i);
+        int n = face.size();
+        if (n < 3) continue;
+
+        bool face_uv = use_tex && m.face_has_uv(i);
+
+        for (int k = 1; k + 1 < n; k++) {
+            int idx[3] = { face[0], face[k], face[k + 1] };
+            ClipVertex v[3];
+            unsigned c[3];
+            for (int j = 0; j < 3; j++) {
+                if (use_vcache) {
+                    const PostTransformCache::Entry& e = vcache_.fetch(idx[j], m, xform_);
+                    v[j] = e.v;
+                    c[j] = e.code;
+                    continue;
+                }
+                v[j].pos = xform_.clip(idx[j]);
+                v[j].screen = xform_.screen(idx[j]);
+                v[j].world = m.vert(idx[j]);
+                v[j].norm = m.normal(idx[j]);
+                c[j] = codes_[idx[j]];
+            }
+
+            BinnedTriangle t;
+            if (face_uv) {
+                v[0].uv = m.uv(i, 0);
+                v[1].uv = m.uv(i, k);
+                v[2].uv = m.uv(i, k + 1);
+                t.kind = TRI_PHONG_TEX;
+            }
+            else {
+                t.color = TGAColor(180, 180, 180, 255);
+                t.kind = TRI_PHONG_FLAT;
+            }
+            prims.process(v, c, t, *tiler_);
+        }
+
+        // Large meshes are drawn in batches as they are binned, so the
+        // binned copies never pile up for the whole mesh.
+        if (tiler_->full()) {
+            zone.switch_to("tiles");
+            tiler_->flush(ctx, light_dir, job.camera, options_.nthreads);
+            zone.switch_to("primitive_assembly");
+        }
+    }
+
+    TGAColor glass(180, 220, 255, 255);
+    float alpha = 0.15f;
+
+    // The glass is seen from both sides.
+    prims.set_cull(CULL_NONE);
+    for (int t = 0; t < 12; t++) {
+        ClipVertex v[3];
+        unsigned c[3];
+        for (int k = 0; k < 3; k++) {
+            v[k].pos = xform_.clip(glass_corners[glass_faces[t][k]]);
+            v[k].screen = xform_.apply(glass_corners[glass_faces[t][k]]);
+            c[k] = clip_outcode(v[k].pos, (float)width_, (float)height_);
+        }
+
+        BinnedTriangle tri;
+        tri.color = glass;
+        tri.alpha = alpha;
+        tri.kind = TRI_ALPHA;
+        prims.process(v, c, tri, *tiler_);
+    }
+
+    zone.switch_to("tiles");
+    tiler_->render(ctx, light_dir, job.camera, options_.nthreads);
+    if (profiling()) profile_frame();
+
+    if (job.output_path.empty()) return true;
+
+    zone.switch_to("tga_write");
+    TGAImage& image = target_.color();
+    image.flip_vertically();
+    bool ok = image.write_tga_file(job.output_path.c_str(), true, options_.nthreads);
+    if (!ok) std::cerr << "Cannot write " << job.output_path << "\n";
+    return ok;
+}
@@ -0,0 +1,81 @@
+#ifndef __RENDERER_H__
+#define __RENDERER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "model.h"
+#include "hiz.h"
+#include "render_context.h"
+#include "tiler.h"
+#include "transform.h"
+#include "clipper.h"
+#include "vertex_cache.h"
+
+// One frame to produce: what to draw, from where, and where to put it.
+struct RenderJob {
+    std::string model_path;
+    std::string output_path;
+    Vec3f camera;
+    Vec3f center;
+    Vec3f up;
+    Vec3f light_dir;
+    int width;
+    int height;
+
+    RenderJob();
+};
+
+struct RenderOptions {
+    int nthreads;
+    bool deferred;
+    bool use_hiz;
+    CullMode cull;
+    // Entries in the post-transform cache; 0 transforms every vertex up
+    // front instead.
+    int vertex_cache;
+    TextureFilter filter;
+
+    RenderOptions();
+};
+
+// Draws the scene (model plus the glass cube) for one job. The render
+// target, binner and vertex cache are kept between calls and only
+// reallocated when the resolution changes, so back-to-back jobs pay for
+// rasterization and nothing else. Renderers share no state: several can
+// run at once on different threads, even on the same Model.
+class FrameRenderer {
+public:
+    FrameRenderer();
+
+    void set_options(const RenderOptions& options);
+    const RenderOptions& options() const;
+
+    // Renders into image() and writes job.output_path when it is not empty.
+    bool render(Model& m, const RenderJob& job);
+
+    TGAImage& image();
+    const PrimitiveStats& primitive_stats() const;
+    const HiZBuffer* hiz_buffer() const;
+    const PostTransformCache* vertex_cache() const;
+
+private:
+    void resize(int w, int h);
+    void profile_frame();
+
+private:
+    RenderOptions options_;
+    int width_;
+    int height_;
+
+    RenderTarget target_;
+    std::unique_ptr<TileRenderer> tiler_;
+    std::unique_ptr<PrimitiveStage> prims_;
+    VertexTransform xform_;
+    std::vector<unsigned> codes_;
+    PostTransformCache vcache_;
+};
+
+#endif
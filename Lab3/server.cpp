@@ -0,0 +1,281 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "server.h"
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+AssetCache::AssetCache(bool quantize, bool mesh_cache, NormalWeighting normals)
+    : entries_(), quantize_(quantize), mesh_cache_(mesh_cache), normals_(normals)
+{
+}
+
+Model* AssetCache::get(const std::string& path) {
+    long long obj_mtime = file_mtime(path);
+    if (obj_mtime < 0) {
+        std::cerr << "Cannot open file: " << path << std::endl;
+        return nullptr;
+    }
+    long long tex_mtime = file_mtime(Model::texture_path(path, "_diffuse.tga"));
+
+    auto it = entries_.find(path);
+    if (it != entries_.end() && it->second.obj_mtime == obj_mtime) {
+        Entry& e = it->second;
+        if (e.tex_mtime != tex_mtime) {
+            e.model->reload_diffuse(path.c_str());
+            e.tex_mtime = tex_mtime;
+        }
+        return e.model.get();
+    }
+
+    Entry& e = entries_[path];
+    e.model.reset(new Model(path.c_str(), 0, mesh_cache_, quantize_));
+    if (normals_ != NORMALS_AREA) e.model->recompute_normals(normals_);
+    e.obj_mtime = obj_mtime;
+    e.tex_mtime = tex_mtime;
+    return e.model.get();
+}
+
+void AssetCache::clear() { entries_.clear(); }
+int AssetCache::size() const { return (int)entries_.size(); }
+
+static bool parse_vec3(const std::string& s, Vec3f& v) {
+    const char* p = s.c_str();
+    float c[3];
+    for (int i = 0; i < 3; i++) {
+        char* end = nullptr;
+        c[i] = std::strtof(p, &end);
+        if (end == p || *end != (i < 2 ? ',' : '\0')) return false;
+        p = end + 1;
+    }
+    v = Vec3f(c[0], c[1], c[2]);
+    return true;
+}
+
+static bool parse_size(const std::string& s, int& w, int& h) {
+    const char* p = s.c_str();
+    char* end = nullptr;
+    long a = std::strtol(p, &end, 10);
+    if (end == p || *end != 'x') return false;
+    p = end + 1;
+    long b = std::strtol(p, &end, 10);
+    if (end == p || *end != '\0' || a <= 0 || b <= 0 || a > 16384 || b > 16384) return false;
+    w = (int)a;
+    h = (int)b;
+    return true;
+}
+
+bool parse_render_job(const std::string& line, RenderJob& job, std::string& error) {
+    std::istringstream in(line);
+    std::string field;
+    while (in >> field) {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos) {
+            error = "expected key=value, got '" + field + "'";
+            return false;
+        }
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        bool ok = true;
+        if (key == "model") job.model_path = value;
+        else if (key == "out") job.output_path = value;
+        else if (key == "camera") ok = parse_vec3(value, job.camera);
+        else if (key == "center") ok = parse_vec3(value, job.center);
+        else if (key == "up") ok = parse_vec3(value, job.up);
+        else if (key == "light") ok = parse_vec3(value, job.light_dir);
+        else if (key == "size") ok = parse_size(value, job.width, job.height);
+        else {
+            error = "unknown field '" + key + "'";
+            return false;
+        }
+
+        if (!ok) {
+            error = "bad value for '" + key + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+RenderServer::RenderServer(const RenderOptions& options, bool quantize, bool mesh_cache, int write_queue,
+    NormalWeighting normals)
+    : cache_(quantize, mesh_cache, normals), renderer_(), writer_(write_queue), quit_(false)
+{
+    renderer_.set_options(options);
+}
+
+bool RenderServer::quit_requested() const { return quit_; }
+
+std::string RenderServer::handle(const std::string& line) {
+    std::string result;
+    submit(line, [&result](const std::string& r) { result = r; });
+    writer_.finish();
+    return result;
+}
+
+void RenderServer::submit(const std::string& line, const std::function<void(const std::string&)>& reply) {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+
+    // Replies that need no write still queue behind the frames before them.
+    auto send = [this, &reply](const std::string& r) { writer_.post([reply, r]() { reply(r); }); };
+    auto ok_reply = [start](const std::string& path) {
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        std::ostringstream s;
+        s << "ok " << path << " " << ms;
+        return s.str();
+    };
+
+    if (line == "quit") {
+        quit_ = true;
+        send("ok quit");
+        return;
+    }
+
+    RenderJob job;
+    std::string error;
+    if (!parse_render_job(line, job, error)) {
+        send("error " + error);
+        return;
+    }
+
+    Model* m = cache_.get(job.model_path);
+    if (!m || m->nverts() == 0 || m->nfaces() == 0) {
+        send("error cannot load " + job.model_path);
+        return;
+    }
+
+    std::string path = job.output_path;
+    job.output_path.clear();
+    if (!renderer_.render(*m, job)) {
+        send("error cannot render " + path);
+        return;
+    }
+    if (path.empty()) {
+        send(ok_reply(path));
+        return;
+    }
+
+    writer_.submit(renderer_.image(), path, [reply, path, ok_reply](bool ok) {
+        reply(ok ? ok_reply(path) : "error cannot write " + path);
+    });
+}
+
+int RenderServer::serve(std::istream& in, std::ostream& out) {
+    std::string line;
+    while (!quit_ && std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        submit(line, [&out](const std::string& r) { out << r << std::endl; });
+    }
+    writer_.finish();
+    return 0;
+}
+
+#ifndef _WIN32
+#ifdef MSG_NOSIGNAL
+static const int send_flags = MSG_NOSIGNAL;
+#else
+static const int send_flags = 0;  // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+// False once the client is gone; a closed peer must not raise SIGPIPE.
+static bool write_all(int fd, const std::string& s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        ssize_t n = send(fd, s.data() + off, s.size() - off, send_flags);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += (size_t)n;
+    }
+    return true;
+}
+
+// Removes a socket left by an earlier run. Anything else at path is left
+// alone, and false returned.
+static bool remove_stale_socket(const char* path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode)) {
+        std::cerr << "Not a socket, refusing to replace: " << path << "\n";
+        return false;
+    }
+    return unlink(path) == 0 || errno == ENOENT;
+}
+
+int RenderServer::serve_socket(const char* path) {
+    sockaddr_un addr;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << "\n";
+        return 1;
+    }
+
+    if (!remove_stale_socket(path)) return 1;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Cannot create socket\n";
+        return 1;
+    }
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path, std::strlen(path) + 1);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0) {
+        std::cerr << "Cannot listen on " << path << "\n";
+        close(listener);
+        return 1;
+    }
+
+    while (!quit_) {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) continue;
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(conn, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+        std::string pending;
+        char buf[4096];
+        std::atomic<bool> alive(true);
+        while (alive && !quit_) {
+            ssize_t n = read(conn, buf, sizeof(buf));
+            if (n <= 0) break;
+            pending.append(buf, (size_t)n);
+
+            size_t nl;
+            while (alive && !quit_ && (nl = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, nl);
+                pending.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty() || line[0] == '#') continue;
+                submit(line, [conn, &alive](const std::string& r) {
+                    if (alive && !write_all(conn, r + "\n")) alive = false;
+                });
+            }
+        }
+        writer_.finish();
+        close(conn);
+    }
+
+    close(listener);
+    remove_stale_socket(path);
+    return 0;
+}
+#else
+int RenderServer::serve_socket(const char* path) {
+    std::cerr << "Unix sockets are not supported on this platform: " << path << "\n";
+    return 1;
+}
+#endif
@@ -0,0 +1,80 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include "model.h"
+#include "renderer.h"
+#include "image_writer.h"
+
+// Parsed models kept in memory by path. An entry is reused for as long as
+// the .obj and its _diffuse.tga keep the modification times they had when
+// loaded; a newer texture is reloaded on its own, a newer .obj rebuilds the
+// whole model.
+class AssetCache {
+public:
+    // quantize loads models with packed vertices, mesh_cache lets them
+    // read and write .lab3mesh files (see Model). Vertex normals are
+    // weighted by normals.
+    explicit AssetCache(bool quantize = false, bool mesh_cache = false, NormalWeighting normals = NORMALS_AREA);
+
+    Model* get(const std::string& path);
+    void clear();
+    int size() const;
+
+private:
+    struct Entry {
+        std::unique_ptr<Model> model;
+        long long obj_mtime;
+        long long tex_mtime;
+    };
+
+    std::map<std::string, Entry> entries_;
+    bool quantize_;
+    bool mesh_cache_;
+    NormalWeighting normals_;
+};
+
+// Parses one job line of whitespace-separated key=value fields:
+//
+//   model=obj/african_head.obj out=view.tga size=1920x1920
+//   camera=1,0,4 center=0,0,0 up=0,1,0 light=0,0,-1
+//
+// Fields left out keep the RenderJob defaults. On failure error says why.
+bool parse_render_job(const std::string& line, RenderJob& job, std::string& error);
+
+// Long-running render mode. Jobs come one per line; every job gets exactly
+// one reply line, "ok <output> <milliseconds>" or "error <reason>". The
+// line "quit" stops the server. Models, textures and framebuffers survive
+// from one job to the next.
+//
+// Finished frames go through an ImageWriter of depth write_queue, so a job
+// renders while the frames before it are still being written. Replies are
+// sent once the file is on disk, in job order; milliseconds run from the
+// job's arrival to then.
+class RenderServer {
+public:
+    RenderServer(const RenderOptions& options, bool quantize = false, bool mesh_cache = false, int write_queue = 2,
+        NormalWeighting normals = NORMALS_AREA);
+
+    // Runs one job to completion and returns its reply.
+    std::string handle(const std::string& line);
+    // Starts one job; reply gets its reply line later, on the writer thread.
+    void submit(const std::string& line, const std::function<void(const std::string&)>& reply);
+    bool quit_requested() const;
+
+    int serve(std::istream& in, std::ostream& out);
+    // Accepts connections on a Unix domain socket, one at a time.
+    int serve_socket(const char* path);
+
+private:
+    AssetCache cache_;
+    FrameRenderer renderer_;
+    ImageWriter writer_;
+    bool quit_;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "shade_simd.h"
+
+#ifdef LAB3_SIMD_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Lanes {
+    enum { W = 8 };
+    typedef __m256 F;
+    typedef __m256i I;
+
+    static F set1(float x) { return _mm256_set1_ps(x); }
+    static I set1i(int x) { return _mm256_set1_epi32(x); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F and_(F a, F b) { return _mm256_and_ps(a, b); }
+    static F cmplt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static int movemask(F a) { return _mm256_movemask_ps(a); }
+    static I cvtt(F a) { return _mm256_cvttps_epi32(a); }
+    static I mini(I a, I b) { return _mm256_min_epi32(a, b); }
+    static I maxi(I a, I b) { return _mm256_max_epi32(a, b); }
+    static void storei(int* p, I v) { _mm256_store_si256((__m256i*)p, v); }
+
+    static I lane_mask(int n) {
+        return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+    static F lanes(int n) { return _mm256_castsi256_ps(lane_mask(n)); }
+
+    static F load(const float* p, int n) {
+        if (n == W) return _mm256_loadu_ps(p);
+        return _mm256_maskload_ps(p, lane_mask(n));
+    }
+    static void store_masked(float* p, F v, F mask, int) {
+        _mm256_maskstore_ps(p, _mm256_castps_si256(mask), v);
+    }
+
+    // Edge values are exact integers well inside double precision, so the
+    // per-lane value and its float rounding match the scalar (float)e.
+    static F edge(long long e, long long step) {
+        __m256d base = _mm256_set1_pd((double)e);
+        __m256d st = _mm256_set1_pd((double)step);
+        __m256d lo = _mm256_add_pd(base, _mm256_mul_pd(st, _mm256_setr_pd(0., 1., 2., 3.)));
+        __m256d hi = _mm256_add_pd(base, _mm256_mul_pd(st, _mm256_setr_pd(4., 5., 6., 7.)));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+    }
+};
+
+#include "shade_simd.inl"
+
+}
+
+int phong_tex_span_avx2(const PhongTexTriangle& t, int y, int x0, int x1) {
+    int written = phong_tex_span_impl<Avx2Lanes>(t, y, x0, x1);
+    _mm256_zeroupper();
+    return written;
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
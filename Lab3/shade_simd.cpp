@@ -0,0 +1,78 @@
+#include "shade_simd.h"
+
+#if defined(LAB3_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#ifdef LAB3_SIMD_X86
+static bool cpu_has_sse4() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+SimdLevel detect_simd_level() {
+#ifdef LAB3_SIMD_X86
+    if (cpu_has_avx2()) return SIMD_AVX2;
+    if (cpu_has_sse4()) return SIMD_SSE4;
+#endif
+    return SIMD_SCALAR;
+}
+
+static SimdLevel& current_level() {
+    static SimdLevel level = detect_simd_level();
+    return level;
+}
+
+SimdLevel simd_level() {
+    return current_level();
+}
+
+void set_simd_level(SimdLevel level) {
+    SimdLevel hw = detect_simd_level();
+    current_level() = level < hw ? level : hw;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2: return "avx2";
+    case SIMD_SSE4: return "sse4";
+    default: return "scalar";
+    }
+}
+
+PhongTexSpanFn phong_tex_span_kernel() {
+#ifdef LAB3_SIMD_X86
+    switch (simd_level()) {
+    case SIMD_AVX2: return phong_tex_span_avx2;
+    case SIMD_SSE4: return phong_tex_span_sse4;
+    default: break;
+    }
+#endif
+    return nullptr;
+}
@@ -0,0 +1,60 @@
+#ifndef __SHADE_SIMD_H__
+#define __SHADE_SIMD_H__
+
+#include "geometry.h"
+#include "graphics.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LAB3_SIMD_X86 1
+#endif
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE4 = 1,
+    SIMD_AVX2 = 2
+};
+
+// Detected once from cpuid; set_simd_level() may lower it (never raise it
+// past what the CPU supports).
+SimdLevel simd_level();
+SimdLevel detect_simd_level();
+void set_simd_level(SimdLevel level);
+const char* simd_level_name(SimdLevel level);
+
+// Everything the packet kernels need for one textured Phong triangle.
+// Lighting vectors are already normalized the way phongColor() does it.
+struct PhongTexTriangle {
+    const TriangleSetup* ts;
+    const Vec3f* pts;
+    const Vec2f* uvs;
+    const Vec3f* norms;
+    const Vec3f* world;
+
+    const unsigned char* tex;
+    int texW, texH, texBpp;
+
+    unsigned char* image;
+    int imageBpp;
+    float* zb;
+    int width;
+
+    Vec3f L;
+    Vec3f minusL;
+    Vec3f eye;
+    float ambient, diffuse, specular;
+    int spec_power;
+};
+
+// Span kernels return the number of pixels they wrote.
+typedef int (*PhongTexSpanFn)(const PhongTexTriangle& t, int y, int x0, int x1);
+
+#ifdef LAB3_SIMD_X86
+int phong_tex_span_sse4(const PhongTexTriangle& t, int y, int x0, int x1);
+int phong_tex_span_avx2(const PhongTexTriangle& t, int y, int x0, int x1);
+#endif
+
+// Returns the widest span kernel for the current level, or nullptr when
+// only the scalar path is available.
+PhongTexSpanFn phong_tex_span_kernel();
+
+#endif
@@ -0,0 +1,153 @@
+// Packet kernel for triangle_phong_tex, shared by the SSE4 and AVX2 builds.
+// The including file defines a lane traits struct S (W lanes, float vector F,
+// int vector I and the handful of ops below) before including this file.
+//
+// Coverage, depth and interpolation reproduce the scalar expressions
+// operation for operation, so the depth test and texel choice match the
+// scalar path bit for bit. Only the specular power differs (repeated
+// squaring instead of std::pow), which keeps the colour within one LSB.
+
+template <class S>
+static inline typename S::F dot3(typename S::F ax, typename S::F ay, typename S::F az,
+    typename S::F bx, typename S::F by, typename S::F bz)
+{
+    return S::add(S::add(S::mul(ax, bx), S::mul(ay, by)), S::mul(az, bz));
+}
+
+template <class S>
+static inline void normalize3(typename S::F& x, typename S::F& y, typename S::F& z) {
+    typename S::F inv = S::div(S::set1(1.f), S::sqrt(dot3<S>(x, y, z, x, y, z)));
+    x = S::mul(x, inv);
+    y = S::mul(y, inv);
+    z = S::mul(z, inv);
+}
+
+template <class S>
+static inline typename S::F lerp3(typename S::F b0, typename S::F b1, typename S::F b2,
+    float a0, float a1, float a2)
+{
+    return S::add(S::add(S::mul(S::set1(a0), b0), S::mul(S::set1(a1), b1)), S::mul(S::set1(a2), b2));
+}
+
+template <class S>
+static inline typename S::F ipow(typename S::F x, int n) {
+    typename S::F r = S::set1(1.f);
+    while (n > 0) {
+        if (n & 1) r = S::mul(r, x);
+        x = S::mul(x, x);
+        n >>= 1;
+    }
+    return r;
+}
+
+template <class S>
+static int phong_tex_span_impl(const PhongTexTriangle& t, int y, int x0, int x1) {
+    typedef typename S::F F;
+    typedef typename S::I I;
+    enum { W = S::W };
+
+    const TriangleSetup& ts = *t.ts;
+    const F inv = S::set1(ts.inv_area);
+    const F zero = S::set1(0.f);
+    const F one = S::set1(1.f);
+    const F c255 = S::set1(255.f);
+    const F texWf = S::set1((float)t.texW);
+    const F texHf = S::set1((float)t.texH);
+    const I texWmax = S::set1i(t.texW - 1);
+    const I texHmax = S::set1i(t.texH - 1);
+    const I izero = S::set1i(0);
+
+    long long e0 = ts.A[0] * x0 + ts.B[0] * y + ts.C[0];
+    long long e1 = ts.A[1] * x0 + ts.B[1] * y + ts.C[1];
+    long long e2 = ts.A[2] * x0 + ts.B[2] * y + ts.C[2];
+
+    float* zrow = t.zb + x0 + y * t.width;
+    unsigned char* crow = t.image + (x0 + y * t.width) * t.imageBpp;
+
+    alignas(32) int txs[W];
+    alignas(32) int tys[W];
+    alignas(32) float texel[4][W];
+    alignas(32) int rgb[3][W];
+    int written = 0;
+
+    for (int x = x0; x <= x1; x += W) {
+        int off = x - x0;
+        int n = x1 - x + 1;
+        if (n > W) n = W;
+
+        F b0 = S::mul(S::edge(e0, ts.A[0]), inv);
+        F b1 = S::mul(S::edge(e1, ts.A[1]), inv);
+        F b2 = S::mul(S::edge(e2, ts.A[2]), inv);
+        e0 += ts.A[0] * W;
+        e1 += ts.A[1] * W;
+        e2 += ts.A[2] * W;
+
+        F z = lerp3<S>(b0, b1, b2, t.pts[0].z, t.pts[1].z, t.pts[2].z);
+        F pass = S::and_(S::cmplt(S::load(zrow + off, n), z), S::lanes(n));
+        int mask = S::movemask(pass);
+        if (!mask) continue;
+        S::store_masked(zrow + off, z, pass, n);
+
+        F u = lerp3<S>(b0, b1, b2, t.uvs[0].x, t.uvs[1].x, t.uvs[2].x);
+        F v = lerp3<S>(b0, b1, b2, t.uvs[0].y, t.uvs[1].y, t.uvs[2].y);
+        S::storei(txs, S::maxi(izero, S::mini(texWmax, S::cvtt(S::mul(u, texWf)))));
+        S::storei(tys, S::maxi(izero, S::mini(texHmax, S::cvtt(S::mul(v, texHf)))));
+
+        for (int k = 0; k < W; k++) {
+            if (mask & (1 << k)) {
+                const unsigned char* p = t.tex + (txs[k] + tys[k] * t.texW) * t.texBpp;
+                texel[0][k] = p[0];
+                texel[1][k] = p[1];
+                texel[2][k] = p[2];
+                texel[3][k] = t.texBpp == 4 ? p[3] : 0.f;
+            }
+            else {
+                texel[0][k] = texel[1][k] = texel[2][k] = texel[3][k] = 0.f;
+            }
+        }
+
+        F Nx = lerp3<S>(b0, b1, b2, t.norms[0].x, t.norms[1].x, t.norms[2].x);
+        F Ny = lerp3<S>(b0, b1, b2, t.norms[0].y, t.norms[1].y, t.norms[2].y);
+        F Nz = lerp3<S>(b0, b1, b2, t.norms[0].z, t.norms[1].z, t.norms[2].z);
+        normalize3<S>(Nx, Ny, Nz);
+        normalize3<S>(Nx, Ny, Nz);
+
+        F Vx = S::sub(S::set1(t.eye.x), lerp3<S>(b0, b1, b2, t.world[0].x, t.world[1].x, t.world[2].x));
+        F Vy = S::sub(S::set1(t.eye.y), lerp3<S>(b0, b1, b2, t.world[0].y, t.world[1].y, t.world[2].y));
+        F Vz = S::sub(S::set1(t.eye.z), lerp3<S>(b0, b1, b2, t.world[0].z, t.world[1].z, t.world[2].z));
+        normalize3<S>(Vx, Vy, Vz);
+
+        F diff = S::max(dot3<S>(Nx, Ny, Nz, S::set1(t.L.x), S::set1(t.L.y), S::set1(t.L.z)), zero);
+
+        F mLx = S::set1(t.minusL.x), mLy = S::set1(t.minusL.y), mLz = S::set1(t.minusL.z);
+        F k2 = S::mul(S::set1(2.f), dot3<S>(mLx, mLy, mLz, Nx, Ny, Nz));
+        F Rx = S::sub(mLx, S::mul(Nx, k2));
+        F Ry = S::sub(mLy, S::mul(Ny, k2));
+        F Rz = S::sub(mLz, S::mul(Nz, k2));
+        normalize3<S>(Rx, Ry, Rz);
+
+        F spec = ipow<S>(S::max(dot3<S>(Rx, Ry, Rz, Vx, Vy, Vz), zero), t.spec_power);
+
+        F ad = S::add(S::set1(t.ambient), S::mul(S::set1(t.diffuse), diff));
+        F s = S::mul(S::set1(t.specular), spec);
+
+        for (int c = 0; c < 3; c++) {
+            F albedo = S::div(S::load(texel[c], W), c255);
+            F col = S::add(S::mul(albedo, ad), s);
+            col = S::max(S::min(col, one), zero);
+            S::storei(rgb[c], S::cvtt(S::mul(col, c255)));
+        }
+
+        unsigned char* dst = crow + off * t.imageBpp;
+        for (int k = 0; k < W; k++) {
+            if (!(mask & (1 << k))) continue;
+            written++;
+            unsigned char* p = dst + k * t.imageBpp;
+            p[0] = (unsigned char)rgb[0][k];
+            p[1] = (unsigned char)rgb[1][k];
+            p[2] = (unsigned char)rgb[2][k];
+            if (t.imageBpp == 4) p[3] = (unsigned char)texel[3][k];
+        }
+    }
+    return written;
+}
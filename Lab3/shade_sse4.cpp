@@ -0,0 +1,86 @@
+#include "shade_simd.h"
+
+#ifdef LAB3_SIMD_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+#include <smmintrin.h>
+
+namespace {
+
+struct Sse4Lanes {
+    enum { W = 4 };
+    typedef __m128 F;
+    typedef __m128i I;
+
+    static F set1(float x) { return _mm_set1_ps(x); }
+    static I set1i(int x) { return _mm_set1_epi32(x); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F sqrt(F a) { return _mm_sqrt_ps(a); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static F and_(F a, F b) { return _mm_and_ps(a, b); }
+    static F cmplt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static int movemask(F a) { return _mm_movemask_ps(a); }
+    static I cvtt(F a) { return _mm_cvttps_epi32(a); }
+    static I mini(I a, I b) { return _mm_min_epi32(a, b); }
+    static I maxi(I a, I b) { return _mm_max_epi32(a, b); }
+    static void storei(int* p, I v) { _mm_store_si128((__m128i*)p, v); }
+
+    static F lanes(int n) {
+        return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(0, 1, 2, 3)));
+    }
+
+    // Tails never touch floats past the span: they may belong to a tile
+    // that another thread is drawing.
+    static F load(const float* p, int n) {
+        if (n == W) return _mm_loadu_ps(p);
+        alignas(16) float tmp[W] = { 0.f, 0.f, 0.f, 0.f };
+        for (int k = 0; k < n; k++) tmp[k] = p[k];
+        return _mm_load_ps(tmp);
+    }
+    static void store_masked(float* p, F v, F mask, int n) {
+        if (n == W) {
+            _mm_storeu_ps(p, _mm_blendv_ps(_mm_loadu_ps(p), v, mask));
+            return;
+        }
+        alignas(16) float tmp[W];
+        _mm_store_ps(tmp, v);
+        int m = _mm_movemask_ps(mask);
+        for (int k = 0; k < n; k++) {
+            if (m & (1 << k)) p[k] = tmp[k];
+        }
+    }
+
+    static F edge(long long e, long long step) {
+        __m128d base = _mm_set1_pd((double)e);
+        __m128d st = _mm_set1_pd((double)step);
+        __m128d lo = _mm_add_pd(base, _mm_mul_pd(st, _mm_setr_pd(0., 1.)));
+        __m128d hi = _mm_add_pd(base, _mm_mul_pd(st, _mm_setr_pd(2., 3.)));
+        return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+    }
+};
+
+#include "shade_simd.inl"
+
+}
+
+int phong_tex_span_sse4(const PhongTexTriangle& t, int y, int x0, int x1) {
+    return phong_tex_span_impl<Sse4Lanes>(t, y, x0, x1);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
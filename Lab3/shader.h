@@ -0,0 +1,259 @@
+#ifndef __SHADER_H__
+#define __SHADER_H__
+
+#include <algorithm>
+#include "graphics.h"
+#include "profiler.h"
+
+// Everything the raster loop knows about one covered pixel.
+struct Fragment {
+    int x, y;
+    int idx;
+    Vec3f bc;
+    float z;
+};
+
+// A shader is any class providing
+//
+//   Vec3f vertex(int nthvert);                       screen position of a corner
+//   bool fragment(const Fragment& f, TGAColor& c);   false discards the pixel
+//
+// plus the compile-time switches below. draw_triangle() is instantiated per
+// shader type, so fragment() is inlined into the pixel loop and the switches
+// fold away: no virtual calls and no per-pixel branching on material.
+// Deriving from ShaderBase picks up the defaults; a shader overrides what it
+// needs by redeclaring it.
+struct ShaderBase {
+    enum {
+        writes_depth = 1,   // store z of fragments that pass the depth test
+        writes_color = 1,   // write the fragment colour to the image
+        blends = 0          // combine with the image through blend()
+    };
+
+    TGAColor blend(const TGAColor&, const TGAColor& src) const { return src; }
+};
+
+// Slack added to the triangle's depth bound before asking the HiZ buffer:
+// interpolated depths can overshoot the vertex depths by a few ulps.
+static const float hiz_depth_margin = 1e-3f;
+
+static inline float plane_max(const TriangleSetup& ts, int x0, int y0, int x1, int y1) {
+    double z = ts.zc + ts.zdx * (ts.zdx > 0. ? x1 : x0) + ts.zdy * (ts.zdy > 0. ? y1 : y0);
+    return std::min((float)z, ts.zmax);
+}
+
+// Walks the covered spans of a set-up triangle. Spans are solved per row
+// from the edge equations, so uncovered pixels are never visited. When the
+// target has a HiZ buffer, the triangle is first tested against the
+// coarsest level and then walked in 8x8 blocks, skipping blocks whose
+// stored depth already hides the triangle.
+template <class Span>
+void raster_triangle(const TriangleSetup& ts, RenderTarget& target, bool writes_depth, Span&& span) {
+    HiZBuffer* h = target.hiz();
+    if (!h) {
+        for (int y = ts.bboxmin.y; y <= ts.bboxmax.y; y++) {
+            int x0, x1;
+            if (triangle_span(ts, y, x0, x1)) span(y, x0, x1);
+        }
+        return;
+    }
+
+    const int B = HiZBuffer::block_size;
+    if (h->reject_rect(ts.bboxmin.x, ts.bboxmin.y, ts.bboxmax.x, ts.bboxmax.y, ts.zmax + hiz_depth_margin)) {
+        h->add_stats(1, 1, 0, 0);
+        return;
+    }
+
+    long long blocks_tested = 0, blocks_culled = 0;
+    int xs[B], xe[B];
+    for (int by0 = ts.bboxmin.y; by0 <= ts.bboxmax.y; by0 = (by0 & ~(B - 1)) + B) {
+        int by1 = std::min(ts.bboxmax.y, (by0 & ~(B - 1)) + B - 1);
+        int lo = ts.bboxmax.x + 1, hi = ts.bboxmin.x - 1;
+        for (int y = by0; y <= by1; y++) {
+            int r = y - by0;
+            if (!triangle_span(ts, y, xs[r], xe[r])) {
+                xs[r] = 1;
+                xe[r] = 0;
+                continue;
+            }
+            lo = std::min(lo, xs[r]);
+            hi = std::max(hi, xe[r]);
+        }
+        if (lo > hi) continue;
+
+        int by = by0 >> HiZBuffer::block_shift;
+        for (int bx = lo >> HiZBuffer::block_shift; bx <= (hi >> HiZBuffer::block_shift); bx++) {
+            int bx0 = std::max(lo, bx * B), bx1 = std::min(hi, bx * B + B - 1);
+            blocks_tested++;
+            if (h->reject_block(bx, by, plane_max(ts, bx0, by0, bx1, by1) + hiz_depth_margin)) {
+                blocks_culled++;
+                continue;
+            }
+            for (int y = by0; y <= by1; y++) {
+                int r = y - by0;
+                int x0 = std::max(xs[r], bx0), x1 = std::min(xe[r], bx1);
+                if (x0 <= x1) span(y, x0, x1);
+            }
+            if (writes_depth) h->mark_dirty(bx, by);
+        }
+    }
+    h->add_stats(1, 0, blocks_tested, blocks_culled);
+}
+
+// Adds one triangle's fragment counts to the profile.
+inline void profile_fragments(long long tested, long long passed, long long shaded) {
+    profile_add(PROF_PIXELS_TESTED, tested);
+    profile_add(PROF_DEPTH_PASSED, passed);
+    profile_add(PROF_FRAGMENTS_SHADED, shaded);
+}
+
+// Count selects the instantiation that tallies fragments for the profiler;
+// the other one has no counting code at all.
+template <bool Count, class Shader>
+void draw_triangle_impl(Shader& shader, RenderTarget& target, const TileRect* clip) {
+    Vec3f pts[3];
+    for (int i = 0; i < 3; i++) pts[i] = shader.vertex(i);
+
+    TriangleSetup ts;
+    if (!setup_triangle(pts, target.width(), target.height(), clip, ts)) return;
+
+    TGAImage* image = &target.color();
+    float* zb = target.depth();
+    int width = target.width();
+    long long tested = 0, passed = 0, shaded = 0;
+
+    raster_triangle(ts, target, Shader::writes_depth != 0, [&](int y, int x0, int x1) {
+        long long e0 = ts.A[0] * x0 + ts.B[0] * y + ts.C[0];
+        long long e1 = ts.A[1] * x0 + ts.B[1] * y + ts.C[1];
+        long long e2 = ts.A[2] * x0 + ts.B[2] * y + ts.C[2];
+        if (Count) tested += x1 - x0 + 1;
+
+        Fragment f;
+        f.y = y;
+        f.idx = x0 + y * width;
+        for (f.x = x0; f.x <= x1; f.x++, f.idx++) {
+            f.bc = Vec3f((float)e0 * ts.inv_area, (float)e1 * ts.inv_area, (float)e2 * ts.inv_area);
+            e0 += ts.A[0];
+            e1 += ts.A[1];
+            e2 += ts.A[2];
+
+            f.z = pts[0].z * f.bc.x + pts[1].z * f.bc.y + pts[2].z * f.bc.z;
+            if (!(zb[f.idx] < f.z)) continue;
+            if (Count) passed++;
+
+            TGAColor color;
+            if (!shader.fragment(f, color)) continue;
+            if (Shader::writes_depth) zb[f.idx] = f.z;
+            if (Shader::writes_color) {
+                if (Shader::blends) color = shader.blend(image->get(f.x, f.y), color);
+                image->set(f.x, f.y, color);
+                if (Count) shaded++;
+            }
+        }
+    });
+
+    if (Count) {
+        profile_fragments(tested, passed, shaded);
+        if (Shader::blends) profile_add(PROF_FRAGMENTS_BLENDED, shaded);
+    }
+}
+
+// Rasterizes one triangle through a shader into the target's colour and
+// depth.
+template <class Shader>
+void draw_triangle(Shader& shader, RenderTarget& target, const TileRect* clip = nullptr) {
+    if (profiling()) draw_triangle_impl<true>(shader, target, clip);
+    else draw_triangle_impl<false>(shader, target, clip);
+}
+
+// Built-in materials behind the triangle_* entry points.
+
+struct FlatShader : ShaderBase {
+    const Vec3f* pts;
+    TGAColor color;
+
+    Vec3f vertex(int i) const { return pts[i]; }
+    bool fragment(const Fragment&, TGAColor& c) const {
+        c = color;
+        return true;
+    }
+};
+
+struct PhongFlatShader : ShaderBase {
+    const Vec3f* pts;
+    const Vec3f* norms;
+    const Vec3f* world;
+    Vec3f light_dir;
+    Vec3f eye;
+    TGAColor albedo;
+
+    Vec3f vertex(int i) const { return pts[i]; }
+    bool fragment(const Fragment& f, TGAColor& c) const {
+        c = shade_phong_flat(f.bc, norms, world, light_dir, eye, albedo);
+        return true;
+    }
+};
+
+struct PhongTexShader : ShaderBase {
+    const RenderContext* ctx;
+    const Vec3f* pts;
+    const Vec2f* uvs;
+    const Vec3f* norms;
+    const Vec3f* world;
+    Vec3f light_dir;
+    Vec3f eye;
+    float lod;
+
+    Vec3f vertex(int i) const { return pts[i]; }
+    bool fragment(const Fragment& f, TGAColor& c) const {
+        c = shade_phong_tex(*ctx, f.bc, uvs, norms, world, light_dir, eye, lod);
+        return true;
+    }
+};
+
+// Constant colour blended over the image; depth is tested but not written.
+struct AlphaShader : ShaderBase {
+    enum { writes_depth = 0, blends = 1 };
+
+    const Vec3f* pts;
+    TGAColor color;
+    float alpha;
+
+    Vec3f vertex(int i) const { return pts[i]; }
+    bool fragment(const Fragment&, TGAColor& c) const {
+        c = color;
+        return true;
+    }
+    TGAColor blend(const TGAColor& dst, const TGAColor& src) const {
+        int r = (int)(src.r * alpha + dst.r * (1.f - alpha));
+        int g = (int)(src.g * alpha + dst.g * (1.f - alpha));
+        int b = (int)(src.b * alpha + dst.b * (1.f - alpha));
+        return TGAColor(clamp_u8(b), clamp_u8(g), clamp_u8(r), 255);
+    }
+
+    static unsigned char clamp_u8(int x) {
+        if (x < 0) return 0;
+        if (x > 255) return 255;
+        return (unsigned char)x;
+    }
+};
+
+// Visibility-buffer pass: records the triangle id and barycentrics instead
+// of a colour.
+struct VisibilityShader : ShaderBase {
+    enum { writes_color = 0 };
+
+    const Vec3f* pts;
+    int id;
+    int* ids;
+    Vec3f* bary;
+
+    Vec3f vertex(int i) const { return pts[i]; }
+    bool fragment(const Fragment& f, TGAColor&) const {
+        ids[f.idx] = id;
+        bary[f.idx] = f.bc;
+        return true;
+    }
+};
+
+#endif
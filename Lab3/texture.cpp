@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "texture.h"
+
+const char* texture_filter_name(TextureFilter filter) {
+    switch (filter) {
+    case TEX_BILINEAR: return "bilinear";
+    case TEX_TRILINEAR: return "trilinear";
+    default: return "point";
+    }
+}
+
+static const int tile_size = 4;
+static const size_t cache_line = 64;
+
+// One tile of 4-byte texels per cache line.
+static_assert(tile_size * tile_size * sizeof(unsigned) == cache_line, "a tile must fill one cache line");
+
+static unsigned* alloc_texels(size_t n) {
+    size_t bytes = std::max<size_t>(1, n) * sizeof(unsigned);
+#ifdef _MSC_VER
+    void* p = _aligned_malloc(bytes, cache_line);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, cache_line, bytes) != 0) p = nullptr;
+#endif
+    if (!p) throw std::bad_alloc();
+    return (unsigned*)p;
+}
+
+void Texture::AlignedFree::operator()(unsigned* p) const {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+// Interleaves the low two bits of x and y.
+static inline int morton4(int x, int y) {
+    return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+}
+
+Texture::Texture() : levels_(), texels_(), bytespp_(0) {
+}
+
+void Texture::clear() {
+    levels_.clear();
+    texels_.reset();
+    bytespp_ = 0;
+}
+
+bool Texture::empty() const { return levels_.empty(); }
+int Texture::levels() const { return (int)levels_.size(); }
+int Texture::width(int level) const { return levels_[level].w; }
+int Texture::height(int level) const { return levels_[level].h; }
+int Texture::bytespp() const { return bytespp_; }
+
+inline unsigned Texture::texel(int level, int x, int y) const {
+    const Level& l = levels_[level];
+    x = std::max(0, std::min(l.w - 1, x));
+    y = std::max(0, std::min(l.h - 1, y));
+    int tile = (y / tile_size) * l.tiles_x + x / tile_size;
+    return texels_[l.offset + tile * tile_size * tile_size + morton4(x, y)];
+}
+
+TGAColor Texture::fetch(int level, int x, int y) const {
+    return TGAColor((int)texel(level, x, y), bytespp_);
+}
+
+void Texture::build(TGAImage& img) {
+    clear();
+    int w = img.get_width(), h = img.get_height();
+    if (w <= 0 || h <= 0 || !img.buffer()) return;
+    bytespp_ = img.get_bytespp();
+
+    size_t total = 0;
+    for (int lw = w, lh = h;; lw = std::max(1, lw / 2), lh = std::max(1, lh / 2)) {
+        Level l;
+        l.w = lw;
+        l.h = lh;
+        l.tiles_x = (lw + tile_size - 1) / tile_size;
+        l.offset = total;
+        total += (size_t)l.tiles_x * ((lh + tile_size - 1) / tile_size) * tile_size * tile_size;
+        levels_.push_back(l);
+        if (lw == 1 && lh == 1) break;
+    }
+    texels_.reset(alloc_texels(total));
+    std::memset(texels_.get(), 0, total * sizeof(unsigned));
+
+    auto store = [&](int level, int x, int y, unsigned c) {
+        const Level& l = levels_[level];
+        int tile = (y / tile_size) * l.tiles_x + x / tile_size;
+        texels_[l.offset + tile * tile_size * tile_size + morton4(x, y)] = c;
+    };
+
+    const unsigned char* data = img.buffer();
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            unsigned c = 0;
+            std::memcpy(&c, data + ((size_t)y * w + x) * bytespp_, bytespp_);
+            store(0, x, y, c);
+        }
+    }
+
+    // Each texel of the next level averages the 2x2 block under it; odd
+    // edges repeat their last row or column.
+    for (int lv = 1; lv < (int)levels_.size(); lv++) {
+        const Level& l = levels_[lv];
+        for (int y = 0; y < l.h; y++) {
+            for (int x = 0; x < l.w; x++) {
+                unsigned s[4] = {
+                    texel(lv - 1, 2 * x, 2 * y), texel(lv - 1, 2 * x + 1, 2 * y),
+                    texel(lv - 1, 2 * x, 2 * y + 1), texel(lv - 1, 2 * x + 1, 2 * y + 1)
+                };
+                unsigned c = 0;
+                for (int ch = 0; ch < 4; ch++) {
+                    unsigned sum = 2;
+                    for (int k = 0; k < 4; k++) sum += (s[k] >> (8 * ch)) & 0xff;
+                    c |= (sum / 4) << (8 * ch);
+                }
+                store(lv, x, y, c);
+            }
+        }
+    }
+}
+
+void Texture::bilinear(int level, float u, float v, float* out) const {
+    const Level& l = levels_[level];
+    float fx = u * l.w - 0.5f;
+    float fy = v * l.h - 0.5f;
+    float x0f = std::floor(fx), y0f = std::floor(fy);
+    float ax = fx - x0f, ay = fy - y0f;
+    int x0 = (int)x0f, y0 = (int)y0f;
+
+    unsigned t00 = texel(level, x0, y0), t10 = texel(level, x0 + 1, y0);
+    unsigned t01 = texel(level, x0, y0 + 1), t11 = texel(level, x0 + 1, y0 + 1);
+    float w00 = (1.f - ax) * (1.f - ay), w10 = ax * (1.f - ay);
+    float w01 = (1.f - ax) * ay, w11 = ax * ay;
+
+    for (int ch = 0; ch < 4; ch++) {
+        int sh = 8 * ch;
+        out[ch] = ((t00 >> sh) & 0xff) * w00 + ((t10 >> sh) & 0xff) * w10
+            + ((t01 >> sh) & 0xff) * w01 + ((t11 >> sh) & 0xff) * w11;
+    }
+}
+
+TGAColor Texture::sample(float u, float v, float lod, TextureFilter filter) const {
+    if (levels_.empty()) return TGAColor();
+
+    int top = (int)levels_.size() - 1;
+    lod = std::max(0.f, std::min((float)top, lod));
+
+    if (filter == TEX_POINT) {
+        const Level& l = levels_[0];
+        int tx = std::max(0, std::min(l.w - 1, (int)(u * l.w)));
+        int ty = std::max(0, std::min(l.h - 1, (int)(v * l.h)));
+        return fetch(0, tx, ty);
+    }
+
+    float c[4];
+    if (filter == TEX_BILINEAR) {
+        bilinear((int)(lod + 0.5f), u, v, c);
+    }
+    else {
+        int l0 = (int)lod;
+        int l1 = std::min(top, l0 + 1);
+        float t = lod - l0;
+        bilinear(l0, u, v, c);
+        if (t > 0.f && l1 != l0) {
+            float c1[4];
+            bilinear(l1, u, v, c1);
+            for (int ch = 0; ch < 4; ch++) c[ch] += (c1[ch] - c[ch]) * t;
+        }
+    }
+
+    unsigned val = 0;
+    for (int ch = 0; ch < 4; ch++) {
+        int b = (int)(c[ch] + 0.5f);
+        val |= (unsigned)std::max(0, std::min(255, b)) << (8 * ch);
+    }
+    return TGAColor((int)val, bytespp_);
+}
+
+float texture_lod(const Vec3f* pts, const Vec2f* uvs, int tex_w, int tex_h) {
+    float x1 = pts[1].x - pts[0].x, y1 = pts[1].y - pts[0].y;
+    float x2 = pts[2].x - pts[0].x, y2 = pts[2].y - pts[0].y;
+    float det = x1 * y2 - x2 * y1;
+    if (det == 0.f) return 0.f;
+
+    float u1 = (uvs[1].x - uvs[0].x) * tex_w, v1 = (uvs[1].y - uvs[0].y) * tex_h;
+    float u2 = (uvs[2].x - uvs[0].x) * tex_w, v2 = (uvs[2].y - uvs[0].y) * tex_h;
+
+    float inv = 1.f / det;
+    float dudx = (u1 * y2 - u2 * y1) * inv, dvdx = (v1 * y2 - v2 * y1) * inv;
+    float dudy = (u2 * x1 - u1 * x2) * inv, dvdy = (v2 * x1 - v1 * x2) * inv;
+
+    float rho2 = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    if (rho2 <= 1.f) return 0.f;
+    return 0.5f * std::log2(rho2);
+}
@@ -0,0 +1,66 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <memory>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+
+enum TextureFilter {
+    TEX_POINT = 0,      // nearest texel of the TGA itself, as before
+    TEX_BILINEAR = 1,   // bilinear in the nearest mip level
+    TEX_TRILINEAR = 2   // bilinear in the two nearest levels, blended
+};
+
+const char* texture_filter_name(TextureFilter filter);
+
+// A TGA with its full mip chain, for filtered sampling. Texels are 4-byte
+// colors with the TGA's own channel bytes. Each level is cut into 4x4
+// tiles stored row by row, texels inside a tile in Morton order. Texels are
+// allocated 64-byte aligned, so a tile is exactly one cache line and a
+// bilinear footprint touches at most four lines whichever way the texture
+// is walked, instead of two rows that are a whole image width apart.
+// Levels are built with a 2x2 box filter.
+class Texture {
+public:
+    Texture();
+
+    void build(TGAImage& img);
+    void clear();
+    bool empty() const;
+
+    int levels() const;
+    int width(int level = 0) const;
+    int height(int level = 0) const;
+    int bytespp() const;
+
+    // Clamped to the level's edges.
+    TGAColor fetch(int level, int x, int y) const;
+    // uv in [0, 1] over the texture; lod is log2 of texels per pixel.
+    TGAColor sample(float u, float v, float lod, TextureFilter filter) const;
+
+private:
+    struct Level {
+        int w, h;
+        int tiles_x;
+        size_t offset;
+    };
+
+    unsigned texel(int level, int x, int y) const;
+    void bilinear(int level, float u, float v, float* out) const;
+
+    struct AlignedFree {
+        void operator()(unsigned* p) const;
+    };
+
+    std::vector<Level> levels_;
+    std::unique_ptr<unsigned[], AlignedFree> texels_;
+    int bytespp_;
+};
+
+// Level of detail for a triangle whose uvs are interpolated affinely in
+// screen space, as the rasterizer does: log2 of the longer of the texel
+// footprints along screen x and y. Constant over the triangle.
+float texture_lod(const Vec3f* pts, const Vec2f* uvs, int tex_w, int tex_h);
+
+#endif
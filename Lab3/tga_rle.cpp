@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "tga_rle.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TGA_RLE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+typedef unsigned long long u64;
+
+static const int max_packet = 128;
+
+static inline int ctz64(u64 x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#elif defined(_MSC_VER)
+    unsigned long i;
+    if (_BitScanForward(&i, (unsigned long)x)) return (int)i;
+    _BitScanForward(&i, (unsigned long)(x >> 32));
+    return (int)i + 32;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static inline bool pixel_eq(const unsigned char* p, int bpp) {
+    return !memcmp(p, p + bpp, bpp);
+}
+
+#ifdef TGA_RLE_SSE2
+// Bit j set when pixel j of p equals pixel j + 1, for 16 pixels; reads 17.
+static inline unsigned eq16(const unsigned char* p, int bpp) {
+    if (bpp == 1) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+        return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+    }
+    if (bpp == 4) {
+        unsigned bits = 0;
+        for (int k = 0; k < 4; k++) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+            __m128i b = _mm_loadu_si128((const __m128i*)(p + 16 * k + 4));
+            bits |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))) << (4 * k);
+        }
+        return bits;
+    }
+
+    // 3 bytes per pixel: compare 48 bytes, then a pixel is equal when its
+    // three byte flags all are.
+    u64 m = 0;
+    for (int k = 0; k < 3; k++) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 16 * k + 3));
+        m |= (u64)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) << (16 * k);
+    }
+    m &= (m >> 1) & (m >> 2);
+    unsigned bits = 0;
+    for (int j = 0; j < 16; j++) bits |= (unsigned)((m >> (3 * j)) & 1) << j;
+    return bits;
+}
+#endif
+
+// Bit i of mask: pixel i equals pixel i + 1. Fills words [w0, w1).
+static void equal_mask(const unsigned char* data, size_t n, int bpp, u64* mask, size_t w0, size_t w1) {
+    for (size_t w = w0; w < w1; w++) {
+        u64 bits = 0;
+        size_t base = w * 64;
+        for (size_t i = base; i < base + 64 && i + 1 < n; i += 16) {
+#ifdef TGA_RLE_SSE2
+            if (i + 17 <= n) {
+                bits |= (u64)eq16(data + i * bpp, bpp) << (i - base);
+                continue;
+            }
+#endif
+            for (size_t j = i; j < i + 16 && j + 1 < n; j++) {
+                if (pixel_eq(data + j * bpp, bpp)) bits |= 1ULL << (j - base);
+            }
+        }
+        mask[w] = bits;
+    }
+}
+
+// Length of the stretch of bits equal to ones starting at bit c, capped at
+// limit.
+static size_t stretch(const u64* mask, size_t c, size_t limit, bool ones) {
+    size_t k = 0;
+    while (k < limit) {
+        size_t i = c + k;
+        u64 w = mask[i >> 6];
+        if (ones) w = ~w;
+        w >>= (i & 63);
+        if (w) {
+            k += ctz64(w);
+            break;
+        }
+        k += 64 - (i & 63);
+    }
+    return std::min(k, limit);
+}
+
+struct RlePacket {
+    unsigned start;
+    unsigned len;
+    bool run;
+};
+
+// The original encoder's choices: from pixel c, a run while neighbours
+// stay equal, otherwise a raw packet up to the pixel before the next
+// equal pair.
+static void parse_packets(const u64* mask, size_t n, std::vector<RlePacket>& packets) {
+    size_t c = 0;
+    while (c < n) {
+        size_t left = n - c;
+        RlePacket p;
+        p.start = (unsigned)c;
+        p.run = left > 1 && ((mask[c >> 6] >> (c & 63)) & 1);
+        size_t len;
+        if (p.run) {
+            len = 1 + stretch(mask, c, std::min<size_t>(max_packet, left) - 1, true);
+        }
+        else {
+            // Like the original, the last pixel of a full raw packet is not
+            // checked against the next one.
+            size_t k = stretch(mask, c + 1, std::min<size_t>(max_packet - 2, left - 1), false);
+            len = std::min<size_t>(k == max_packet - 2 ? max_packet : k + 1, left);
+        }
+        p.len = (unsigned)len;
+        packets.push_back(p);
+        c += len;
+    }
+}
+
+// Grayscale only: raw, run of two, raw costs 3 headers and k + 1 + m
+// bytes; a single raw packet holding all of it costs one byte less.
+static void fold_short_runs(std::vector<RlePacket>& packets) {
+    size_t o = 0;
+    for (size_t i = 0; i < packets.size(); i++) {
+        if (o > 0 && i + 1 < packets.size() && !packets[o - 1].run && packets[i].run && packets[i].len == 2
+            && !packets[i + 1].run && packets[o - 1].len + 2 + packets[i + 1].len <= (unsigned)max_packet)
+        {
+            packets[o - 1].len += 2 + packets[i + 1].len;
+            i++;
+            continue;
+        }
+        packets[o++] = packets[i];
+    }
+    packets.resize(o);
+}
+
+static inline size_t packet_bytes(const RlePacket& p, int bpp) {
+    return 1 + (size_t)(p.run ? 1 : p.len) * bpp;
+}
+
+template <class F>
+static void parallel_for(int nthreads, F f) {
+    std::vector<std::thread> pool;
+    pool.reserve(nthreads - 1);
+    for (int t = 1; t < nthreads; t++) pool.emplace_back(f, t);
+    f(0);
+    for (auto& th : pool) th.join();
+}
+
+void tga_rle_encode(const unsigned char* data, size_t npixels, int bpp,
+    std::vector<unsigned char>& out, int nthreads)
+{
+    if (npixels == 0) return;
+    if (nthreads <= 0) nthreads = std::max(1, (int)std::thread::hardware_concurrency());
+    // Below this, starting threads costs more than it saves.
+    const size_t min_pixels_per_thread = 1 << 16;
+    nthreads = (int)std::max<size_t>(1, std::min<size_t>(nthreads, npixels / min_pixels_per_thread));
+
+    size_t nwords = (npixels + 63) / 64;
+    std::vector<u64> mask(nwords + 1, 0);  // one spare word for stretch()
+    parallel_for(nthreads, [&](int t) {
+        equal_mask(data, npixels, bpp, mask.data(), nwords * t / nthreads, nwords * (t + 1) / nthreads);
+    });
+
+    std::vector<RlePacket> packets;
+    packets.reserve(npixels / 32 + 16);
+    parse_packets(mask.data(), npixels, packets);
+    if (bpp == 1) fold_short_runs(packets);
+
+    // Each thread sizes its share of the packets, then writes it at its
+    // offset, so the shares need no stitching afterwards.
+    size_t np = packets.size();
+    std::vector<size_t> offset(nthreads + 1, 0);
+    parallel_for(nthreads, [&](int t) {
+        size_t bytes = 0;
+        for (size_t i = np * t / nthreads; i < np * (t + 1) / nthreads; i++) bytes += packet_bytes(packets[i], bpp);
+        offset[t + 1] = bytes;
+    });
+    size_t base = out.size();
+    offset[0] = base;
+    for (int t = 0; t < nthreads; t++) offset[t + 1] += offset[t];
+    out.resize(offset[nthreads]);
+
+    unsigned char* dst = out.data();
+    parallel_for(nthreads, [&](int t) {
+        unsigned char* o = dst + offset[t];
+        for (size_t i = np * t / nthreads; i < np * (t + 1) / nthreads; i++) {
+            const RlePacket& p = packets[i];
+            const unsigned char* src = data + (size_t)p.start * bpp;
+            *o++ = (unsigned char)(p.run ? p.len + 127 : p.len - 1);
+            size_t bytes = (size_t)(p.run ? 1 : p.len) * bpp;
+            memcpy(o, src, bytes);
+            o += bytes;
+        }
+    });
+}
@@ -0,0 +1,22 @@
+#ifndef __TGA_RLE_H__
+#define __TGA_RLE_H__
+
+#include <cstddef>
+#include <vector>
+
+// TGA run-length encoding of npixels pixels of bpp bytes, appended to out.
+//
+// Packets are chosen exactly as the original serial encoder chose them
+// (runs of equal pixels, raw packets stopping before a pair, at most 128
+// pixels each, crossing scanlines), so files come out byte for byte the
+// same, except that a grayscale run of two between raw packets is folded
+// into them, which is one byte shorter. The output is never larger.
+//
+// Work is split in three passes: threads flag equal neighbours with SIMD
+// compares, one thread walks the flags a packet at a time, and threads
+// write the packets of their share straight to its final offset in out.
+// nthreads 0 picks the core count; small images are encoded on one.
+void tga_rle_encode(const unsigned char* data, size_t npixels, int bpp,
+    std::vector<unsigned char>& out, int nthreads = 0);
+
+#endif
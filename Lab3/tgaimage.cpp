@@ -1,9 +1,13 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <utility>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 #include "tgaimage.h"
+#include "mapped_file.h"
+#include "tga_rle.h"
 
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
 }
@@ -40,125 +44,182 @@ TGAImage& TGAImage::operator =(const TGAImage& img) {
 	return *this;
 }
 
+void TGAImage::swap(TGAImage& img) {
+	std::swap(data, img.data);
+	std::swap(width, img.width);
+	std::swap(height, img.height);
+	std::swap(bytespp, img.bytespp);
+}
+
 bool TGAImage::read_tga_file(const char* filename) {
-	if (data) delete[] data;
-	data = NULL;
-	std::ifstream in;
-	in.open(filename, std::ios::binary);
-	if (!in.is_open()) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		if (data) delete[] data;
+		data = NULL;
+		width = height = bytespp = 0;
 		std::cerr << "can't open file " << filename << "\n";
-		in.close();
 		return false;
 	}
+	if (!read_tga_buffer((const unsigned char*)file.data(), file.size())) return false;
+	std::cerr << width << "x" << height << "/" << bytespp * 8 << "\n";
+	return true;
+}
+
+// Decodes straight from memory into the final top-to-bottom, left-to-right
+// layout: the origin bits of the descriptor only decide where each decoded
+// row and pixel lands, so no flip pass follows. Every read is checked
+// against the end of the buffer.
+bool TGAImage::read_tga_buffer(const unsigned char* buf, size_t size) {
+	if (data) delete[] data;
+	data = NULL;
+	width = height = bytespp = 0;
+
 	TGA_Header header;
-	in.read((char*)&header, sizeof(header));
-	if (!in.good()) {
-		in.close();
+	if (size < sizeof(header)) {
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
-	width = header.width;
-	height = header.height;
-	bytespp = header.bitsperpixel >> 3;
-	if (width <= 0 || height <= 0 || (bytespp != GRAYSCALE && bytespp != RGB && bytespp != RGBA)) {
-		in.close();
+	memcpy(&header, buf, sizeof(header));
+	int w = header.width;
+	int h = header.height;
+	int bpp = header.bitsperpixel >> 3;
+	if (w <= 0 || h <= 0 || (bpp != GRAYSCALE && bpp != RGB && bpp != RGBA)) {
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
-	unsigned long nbytes = bytespp * width * height;
-	data = new unsigned char[nbytes];
-	if (3 == header.datatypecode || 2 == header.datatypecode) {
-		in.read((char*)data, nbytes);
-		if (!in.good()) {
-			in.close();
-			std::cerr << "an error occured while reading the data\n";
-			return false;
-		}
+	bool rle = 10 == header.datatypecode || 11 == header.datatypecode;
+	if (!rle && 2 != header.datatypecode && 3 != header.datatypecode) {
+		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
+		return false;
 	}
-	else if (10 == header.datatypecode || 11 == header.datatypecode) {
-		if (!load_rle_data(in)) {
-			in.close();
-			std::cerr << "an error occured while reading the data\n";
-			return false;
-		}
+
+	// The image id and a colour map (unused by true-colour images) sit
+	// between the header and the pixels.
+	size_t offset = sizeof(header) + (unsigned char)header.idlength;
+	if (header.colormaptype) offset += (size_t)(unsigned short)header.colormaplength * (((unsigned char)header.colormapdepth + 7) >> 3);
+	if (offset > size) {
+		std::cerr << "an error occured while reading the header\n";
+		return false;
 	}
-	else {
-		in.close();
-		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
+
+	width = w;
+	height = h;
+	bytespp = bpp;
+	size_t nbytes = (size_t)width * height * bytespp;
+	data = new unsigned char[nbytes];
+
+	bool top_down = (header.imagedescriptor & 0x20) != 0;
+	bool right_to_left = (header.imagedescriptor & 0x10) != 0;
+	bool ok = rle ? load_rle_data(buf + offset, buf + size, top_down, right_to_left)
+		: load_raw_data(buf + offset, buf + size, top_down, right_to_left);
+	if (!ok) {
+		std::cerr << "an error occured while reading the data\n";
+		delete[] data;
+		data = NULL;
+		width = height = bytespp = 0;
 		return false;
 	}
-	if (!(header.imagedescriptor & 0x20)) {
-		flip_vertically();
+	return true;
+}
+
+// Pixels [x, x + n) of file row r (in file order) go to this destination.
+unsigned char* TGAImage::row_span(int r, int x, int n, bool top_down, bool right_to_left) {
+	int y = top_down ? r : height - 1 - r;
+	if (right_to_left) x = width - x - n;
+	return data + ((size_t)y * width + x) * bytespp;
+}
+
+static void copy_reversed(unsigned char* dst, const unsigned char* src, int n, int bpp) {
+	for (int i = 0; i < n; i++) memcpy(dst + (size_t)(n - 1 - i) * bpp, src + (size_t)i * bpp, bpp);
+}
+
+template <int Bpp>
+static inline void fill_fixed(unsigned char* dst, const unsigned char* px, int n) {
+	for (int i = 0; i < n; i++, dst += Bpp) memcpy(dst, px, Bpp);
+}
+
+// Writes n copies of the pixel at px. Short runs use fixed-size stores the
+// compiler turns into plain moves; long ones copy the filled prefix onto
+// the rest, doubling it each time, so they go out in a few wide memcpys.
+static void fill_pixels(unsigned char* dst, const unsigned char* px, int n, int bpp) {
+	if (1 == bpp) {
+		memset(dst, px[0], n);
+		return;
+	}
+	if (n <= 16) {
+		if (4 == bpp) fill_fixed<4>(dst, px, n);
+		else fill_fixed<3>(dst, px, n);
+		return;
 	}
-	if (header.imagedescriptor & 0x10) {
-		flip_horizontally();
+	size_t total = (size_t)n * bpp;
+	if (4 == bpp) fill_fixed<4>(dst, px, 16);
+	else fill_fixed<3>(dst, px, 16);
+	size_t filled = (size_t)16 * bpp;
+	while (filled < total) {
+		size_t chunk = filled < total - filled ? filled : total - filled;
+		memcpy(dst + filled, dst, chunk);
+		filled += chunk;
+	}
+}
+
+bool TGAImage::load_raw_data(const unsigned char* p, const unsigned char* end, bool top_down, bool right_to_left) {
+	size_t line = (size_t)width * bytespp;
+	if ((size_t)(end - p) < line * height) return false;
+	if (top_down && !right_to_left) {
+		memcpy(data, p, line * height);
+		return true;
+	}
+	for (int r = 0; r < height; r++, p += line) {
+		unsigned char* dst = row_span(r, 0, width, top_down, right_to_left);
+		if (right_to_left) copy_reversed(dst, p, width, bytespp);
+		else memcpy(dst, p, line);
 	}
-	std::cerr << width << "x" << height << "/" << bytespp * 8 << "\n";
-	in.close();
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream& in) {
-	unsigned long pixelcount = width * height;
-	unsigned long currentpixel = 0;
-	unsigned long currentbyte = 0;
-	TGAColor colorbuffer;
-	do {
-		unsigned char chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
-			std::cerr << "an error occured while reading the data\n";
+bool TGAImage::load_rle_data(const unsigned char* p, const unsigned char* end, bool top_down, bool right_to_left) {
+	size_t pixelcount = (size_t)width * height;
+	size_t currentpixel = 0;
+	int r = 0, x = 0;
+	while (currentpixel < pixelcount) {
+		if (p >= end) return false;
+		unsigned char chunkheader = *p++;
+		bool run = chunkheader >= 128;
+		int count = (chunkheader & 0x7f) + 1;
+		if ((size_t)count > pixelcount - currentpixel) {
+			std::cerr << "Too many pixels read\n";
 			return false;
 		}
-		if (chunkheader < 128) {
-			chunkheader++;
-			for (int i = 0; i < chunkheader; i++) {
-				in.read((char*)colorbuffer.raw, bytespp);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t = 0; t < bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel > pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
-		}
-		else {
-			chunkheader -= 127;
-			in.read((char*)colorbuffer.raw, bytespp);
-			if (!in.good()) {
-				std::cerr << "an error occured while reading the header\n";
-				return false;
+		size_t payload = (size_t)(run ? 1 : count) * bytespp;
+		if ((size_t)(end - p) < payload) return false;
+		currentpixel += count;
+
+		// A packet may continue on the next row.
+		const unsigned char* src = p;
+		while (count > 0) {
+			int n = width - x < count ? width - x : count;
+			unsigned char* dst = row_span(r, x, n, top_down, right_to_left);
+			if (run) fill_pixels(dst, src, n, bytespp);
+			else {
+				if (right_to_left) copy_reversed(dst, src, n, bytespp);
+				else memcpy(dst, src, (size_t)n * bytespp);
+				src += (size_t)n * bytespp;
 			}
-			for (int i = 0; i < chunkheader; i++) {
-				for (int t = 0; t < bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel > pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
+			count -= n;
+			x += n;
+			if (x == width) {
+				x = 0;
+				r++;
 			}
 		}
-	} while (currentpixel < pixelcount);
+		p += payload;
+	}
 	return true;
 }
 
-bool TGAImage::write_tga_file(const char* filename, bool rle) {
-	unsigned char developer_area_ref[4] = { 0, 0, 0, 0 };
-	unsigned char extension_area_ref[4] = { 0, 0, 0, 0 };
-	unsigned char footer[18] = { 'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0' };
-	std::ofstream out;
-	out.open(filename, std::ios::binary);
-	if (!out.is_open()) {
-		std::cerr << "can't open file " << filename << "\n";
-		out.close();
-		return false;
-	}
+bool TGAImage::write_tga_file(const char* filename, bool rle, int nthreads) {
+	unsigned char footer[26] = { 0, 0, 0, 0, 0, 0, 0, 0, // developer and extension area refs
+		'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0' };
 	TGA_Header header;
 	memset((void*)&header, 0, sizeof(header));
 	header.bitsperpixel = bytespp << 3;
@@ -166,40 +227,28 @@ bool TGAImage::write_tga_file(const char* filename, bool rle) {
 	header.height = height;
 	header.datatypecode = (bytespp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
 	header.imagedescriptor = 0x20; // top-left origin
-	out.write((char*)&header, sizeof(header));
-	if (!out.good()) {
-		out.close();
-		std::cerr << "can't dump the tga file\n";
-		return false;
-	}
+
+	// the whole file is assembled in memory and written at once
+	size_t nbytes = (size_t)width * height * bytespp;
+	std::vector<unsigned char> file;
+	file.reserve(sizeof(header) + (rle ? nbytes / 2 : nbytes) + sizeof(footer));
+	file.insert(file.end(), (unsigned char*)&header, (unsigned char*)&header + sizeof(header));
 	if (!rle) {
-		out.write((char*)data, width * height * bytespp);
-		if (!out.good()) {
-			std::cerr << "can't unload raw data\n";
-			out.close();
-			return false;
-		}
+		file.insert(file.end(), data, data + nbytes);
 	}
 	else {
-		if (!unload_rle_data(out)) {
-			out.close();
-			std::cerr << "can't unload rle data\n";
-			return false;
-		}
+		tga_rle_encode(data, (size_t)width * height, bytespp, file, nthreads);
 	}
-	out.write((char*)developer_area_ref, sizeof(developer_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
-	}
-	out.write((char*)extension_area_ref, sizeof(extension_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
+	file.insert(file.end(), footer, footer + sizeof(footer));
+
+	std::ofstream out;
+	out.open(filename, std::ios::binary);
+	if (!out.is_open()) {
+		std::cerr << "can't open file " << filename << "\n";
 		out.close();
 		return false;
 	}
-	out.write((char*)footer, sizeof(footer));
+	out.write((char*)file.data(), file.size());
 	if (!out.good()) {
 		std::cerr << "can't dump the tga file\n";
 		out.close();
@@ -209,49 +258,6 @@ bool TGAImage::write_tga_file(const char* filename, bool rle) {
 	return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream& out) {
-	const unsigned char max_chunk_length = 128;
-	unsigned long npixels = width * height;
-	unsigned long curpix = 0;
-	while (curpix < npixels) {
-		unsigned long chunkstart = curpix * bytespp;
-		unsigned long curbyte = curpix * bytespp;
-		unsigned char run_length = 1;
-		bool raw = true;
-		while (curpix + run_length < npixels && run_length < max_chunk_length) {
-			bool succ_eq = true;
-			for (int t = 0; succ_eq && t < bytespp; t++) {
-				succ_eq = (data[curbyte + t] == data[curbyte + t + bytespp]);
-			}
-			curbyte += bytespp;
-			if (1 == run_length) {
-				raw = !succ_eq;
-			}
-			if (raw && succ_eq) {
-				run_length--;
-				break;
-			}
-			if (!raw && !succ_eq) {
-				break;
-			}
-			run_length++;
-		}
-		curpix += run_length;
-		out.put(raw ? run_length - 1 : run_length + 127);
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
-		out.write((char*)(data + chunkstart), (raw ? run_length * bytespp : bytespp));
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
-	}
-	return true;
-}
-
 TGAColor TGAImage::get(int x, int y) {
 	if (!data || x < 0 || y < 0 || x >= width || y >= height) {
 		return TGAColor();
@@ -1,6 +1,7 @@
 #ifndef __IMAGE_H__
 #define __IMAGE_H__
 
+#include <cstddef>
 #include <fstream>
 
 #pragma pack(push,1)
@@ -67,8 +68,9 @@ protected:
 	int height;
 	int bytespp;
 
-	bool   load_rle_data(std::ifstream& in);
-	bool unload_rle_data(std::ofstream& out);
+	bool   load_raw_data(const unsigned char* p, const unsigned char* end, bool top_down, bool right_to_left);
+	bool   load_rle_data(const unsigned char* p, const unsigned char* end, bool top_down, bool right_to_left);
+	unsigned char* row_span(int r, int x, int n, bool top_down, bool right_to_left);
 public:
 	enum Format {
 		GRAYSCALE = 1, RGB = 3, RGBA = 4
@@ -78,7 +80,10 @@ public:
 	TGAImage(int w, int h, int bpp);
 	TGAImage(const TGAImage& img);
 	bool read_tga_file(const char* filename);
-	bool write_tga_file(const char* filename, bool rle = true);
+	// Decodes a whole TGA file held in memory.
+	bool read_tga_buffer(const unsigned char* buf, size_t size);
+	// nthreads for the rle encoder; 0 uses all cores
+	bool write_tga_file(const char* filename, bool rle = true, int nthreads = 0);
 	bool flip_horizontally();
 	bool flip_vertically();
 	bool scale(int w, int h);
@@ -86,6 +91,8 @@ public:
 	bool set(int x, int y, TGAColor c);
 	~TGAImage();
 	TGAImage& operator =(const TGAImage& img);
+	// exchanges pixels and size with img without copying
+	void swap(TGAImage& img);
 	int get_width();
 	int get_height();
 	int get_bytespp();
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "tiler.h"
+#include "profiler.h"
+
+TileRenderer::TileRenderer(int w, int h, int tile_size, int batch_size)
+    : width_(w), height_(h), tile_size_(tile_size),
+    tiles_x_((w + tile_size - 1) / tile_size),
+    tiles_y_((h + tile_size - 1) / tile_size),
+    batch_size_(std::max(1, batch_size)), drawn_(0), kept_(0), tris_(), bins_(tiles_x_ * tiles_y_), deferred_(false), lod_w_(0), lod_h_(0), vis_ids_(), vis_bary_(),
+    unresolved_(tiles_x_ * tiles_y_, 0)
+{
+}
+
+void TileRenderer::set_deferred(bool deferred) {
+    deferred_ = deferred;
+    if (deferred_ && vis_ids_.empty()) {
+        vis_ids_.assign(width_ * height_, -1);
+        vis_bary_.resize(width_ * height_);
+    }
+}
+
+void TileRenderer::set_lod_texture(int w, int h) {
+    lod_w_ = w;
+    lod_h_ = h;
+}
+
+void TileRenderer::submit(const BinnedTriangle& t) {
+    Vec2i bboxmin, bboxmax;
+    bbox_of_triangle(t.pts, width_, height_, bboxmin, bboxmax);
+    if (bboxmin.x > bboxmax.x || bboxmin.y > bboxmax.y) return;
+
+    int id = (int)tris_.size();
+    tris_.push_back(t);
+    BinnedTriangle& b = tris_.back();
+    b.lod = deferred_ && lod_w_ > 0 && t.kind == TRI_PHONG_TEX ? texture_lod(t.pts, t.uvs, lod_w_, lod_h_) : 0.f;
+
+    int tx0 = bboxmin.x / tile_size_, tx1 = bboxmax.x / tile_size_;
+    int ty0 = bboxmin.y / tile_size_, ty1 = bboxmax.y / tile_size_;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            bins_[tx + ty * tiles_x_].push_back(id);
+        }
+    }
+}
+
+bool TileRenderer::full() const { return (int)tris_.size() - kept_ >= batch_size_; }
+
+void TileRenderer::render_tile(int tile, const RenderContext& ctx,
+    const Vec3f& light_dir, const Vec3f& eyePos, bool resolve)
+{
+    const std::vector<int>& bin = bins_[tile];
+    bool pending = unresolved_[tile] != 0;
+    if (bin.empty() && !(resolve && pending)) return;
+
+    TileRect clip;
+    clip.x0 = (tile % tiles_x_) * tile_size_;
+    clip.y0 = (tile / tiles_x_) * tile_size_;
+    clip.x1 = std::min(width_, clip.x0 + tile_size_) - 1;
+    clip.y1 = std::min(height_, clip.y0 + tile_size_) - 1;
+
+    // Forward shading rasterizes and shades in one go, so its opaque
+    // triangles show up as "raster".
+    ProfileZone zone("raster");
+    for (int id : bin) {
+        const BinnedTriangle& t = tris_[id];
+        if (deferred_ && t.kind != TRI_ALPHA) {
+            zone.switch_to("raster");
+            triangle_visibility(ctx, t.pts, id, vis_ids_.data(), vis_bary_.data(), &clip);
+            pending = true;
+            continue;
+        }
+        if (pending) {
+            zone.switch_to("shade");
+            resolve_tile(clip, ctx, light_dir, eyePos);
+            pending = false;
+        }
+
+        zone.switch_to(t.kind == TRI_ALPHA ? "alpha" : "raster");
+        switch (t.kind) {
+        case TRI_PHONG_TEX:
+            triangle_phong_tex(ctx, t.pts, t.uvs, t.norms, t.world, light_dir, eyePos, &clip);
+            break;
+        case TRI_PHONG_FLAT:
+            triangle_phong_flat(ctx, t.pts, t.norms, t.world, light_dir, eyePos, t.color, &clip);
+            break;
+        case TRI_ALPHA:
+            triangle_alpha(ctx, t.pts, t.color, t.alpha, &clip);
+            break;
+        }
+    }
+    if (pending && resolve) {
+        zone.switch_to("shade");
+        resolve_tile(clip, ctx, light_dir, eyePos);
+        pending = false;
+    }
+    unresolved_[tile] = pending;
+}
+
+void TileRenderer::resolve_tile(const TileRect& clip, const RenderContext& ctx,
+    const Vec3f& light_dir, const Vec3f& eyePos)
+{
+    TGAImage& image = ctx.target->color();
+    long long shaded = 0;
+
+    for (int y = clip.y0; y <= clip.y1; y++) {
+        for (int x = clip.x0; x <= clip.x1; x++) {
+            int idx = x + y * width_;
+            int id = vis_ids_[idx];
+            if (id < 0) continue;
+            vis_ids_[idx] = -1;
+            shaded++;
+
+            const BinnedTriangle& t = tris_[id];
+            const Vec3f& bc = vis_bary_[idx];
+
+            if (t.kind == TRI_PHONG_TEX) {
+                image.set(x, y, shade_phong_tex(ctx, bc, t.uvs, t.norms, t.world, light_dir, eyePos, t.lod));
+            }
+            else {
+                image.set(x, y, shade_phong_flat(bc, t.norms, t.world, light_dir, eyePos, t.color));
+            }
+        }
+    }
+    if (profiling()) profile_add(PROF_FRAGMENTS_SHADED, shaded);
+}
+
+void TileRenderer::flush(const RenderContext& ctx,
+    const Vec3f& light_dir, const Vec3f& eyePos, int nthreads)
+{
+    draw(ctx, light_dir, eyePos, nthreads, false);
+}
+
+void TileRenderer::render(const RenderContext& ctx,
+    const Vec3f& light_dir, const Vec3f& eyePos, int nthreads)
+{
+    draw(ctx, light_dir, eyePos, nthreads, true);
+}
+
+void TileRenderer::draw(const RenderContext& ctx, const Vec3f& light_dir, const Vec3f& eyePos,
+    int nthreads, bool resolve)
+{
+    if ((int)tris_.size() == kept_ && !resolve) return;
+    if (tris_.empty()) return;
+    int ntiles = tiles_x_ * tiles_y_;
+    nthreads = std::max(1, std::min(nthreads, ntiles));
+
+    // HiZ cells coarser than a tile would be shared between workers.
+    HiZBuffer* hiz = ctx.target->hiz();
+    if (hiz && tile_size_ % hiz->cell_size(hiz->nlevels() - 1) != 0) nthreads = 1;
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (;;) {
+            int tile = next.fetch_add(1, std::memory_order_relaxed);
+            if (tile >= ntiles) break;
+            render_tile(tile, ctx, light_dir, eyePos, resolve);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(nthreads - 1);
+    for (int i = 1; i < nthreads; i++) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+
+    drawn_ += (int)tris_.size() - kept_;
+    for (auto& bin : bins_) bin.clear();
+    if (deferred_ && !resolve) {
+        keep_visible();
+    }
+    else {
+        tris_.clear();
+        kept_ = 0;
+    }
+}
+
+// Moves the triangles the visibility buffer still points to to the front
+// of tris_ and drops the rest. At most one per pixel survives.
+void TileRenderer::keep_visible() {
+    std::vector<int> remap(tris_.size(), -1);
+    for (int id : vis_ids_) {
+        if (id >= 0) remap[id] = 0;
+    }
+    // In id order, so no triangle is overwritten before it has moved.
+    int n = 0;
+    for (int id = 0; id < (int)tris_.size(); id++) {
+        if (remap[id] < 0) continue;
+        remap[id] = n;
+        tris_[n++] = tris_[id];
+    }
+    for (int& id : vis_ids_) {
+        if (id >= 0) id = remap[id];
+    }
+    tris_.resize(n);
+    kept_ = n;
+}
+
+void TileRenderer::clear() {
+    drawn_ = 0;
+    kept_ = 0;
+    tris_.clear();
+    for (auto& bin : bins_) bin.clear();
+    if (deferred_) std::fill(vis_ids_.begin(), vis_ids_.end(), -1);
+    std::fill(unresolved_.begin(), unresolved_.end(), 0);
+}
+
+int TileRenderer::ntriangles() const { return drawn_ + (int)tris_.size() - kept_; }
+int TileRenderer::ntiles() const { return tiles_x_ * tiles_y_; }
+
+int default_thread_count() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,104 @@
+#ifndef __TILER_H__
+#define __TILER_H__
+
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "graphics.h"
+
+enum TriangleKind {
+    TRI_PHONG_TEX,
+    TRI_PHONG_FLAT,
+    TRI_ALPHA
+};
+
+// Screen-space triangle captured by the binning front end. Everything the
+// triangle_* routines need is copied in, so tiles can be drawn in any order.
+struct BinnedTriangle {
+    Vec3f pts[3];
+    Vec2f uvs[3];
+    Vec3f norms[3];
+    Vec3f world[3];
+    TGAColor color;
+    float alpha;
+    TriangleKind kind;
+    // Mip level for deferred shading, filled in by TileRenderer::submit.
+    float lod;
+};
+
+// Sorts triangles into fixed-size screen tiles and rasterizes the tiles on a
+// pool of worker threads. A tile is only ever touched by one thread, and each
+// tile replays its triangles in submission order, so the image and z-buffer
+// come out exactly as the serial loop would leave them.
+//
+// With deferred shading on, opaque triangles only write depth, triangle id
+// and barycentrics into a visibility buffer. Each tile is resolved (shaded
+// once per pixel) before its next alpha triangle and at the end of the tile.
+//
+// Only batch_size triangles need to be queued at once: flush() may be
+// called whenever full() says so and the next triangles binned afterwards.
+// Every pixel still sees its triangles in submission order, so the image
+// is the same; memory stays bounded however large the mesh. In deferred
+// mode a flush leaves the visibility buffer unresolved and keeps just the
+// triangles it still points to, so each pixel is still shaded only once.
+class TileRenderer {
+public:
+    TileRenderer(int w, int h, int tile_size = 64, int batch_size = 1 << 16);
+
+    void set_deferred(bool deferred);
+    // Size of the filtered diffuse texture, so deferred shading can pick
+    // each textured triangle's mip level once at submit; 0 for none.
+    void set_lod_texture(int w, int h);
+    void submit(const BinnedTriangle& t);
+    bool full() const;
+    // Draws the queued triangles into ctx.target, which must match the size
+    // given at construction, and drops them. Deferred shading is left for
+    // the next flush() or render().
+    void flush(const RenderContext& ctx,
+        const Vec3f& light_dir, const Vec3f& eyePos, int nthreads);
+    // Like flush(), then finishes the frame: every pixel is shaded.
+    void render(const RenderContext& ctx,
+        const Vec3f& light_dir, const Vec3f& eyePos, int nthreads);
+    // Drops queued triangles and starts counting from zero.
+    void clear();
+
+    // Triangles binned since clear(), drawn or not.
+    int ntriangles() const;
+    int ntiles() const;
+
+private:
+    void draw(const RenderContext& ctx, const Vec3f& light_dir, const Vec3f& eyePos,
+        int nthreads, bool resolve);
+    void render_tile(int tile, const RenderContext& ctx,
+        const Vec3f& light_dir, const Vec3f& eyePos, bool resolve);
+    void keep_visible();
+    void resolve_tile(const TileRect& clip, const RenderContext& ctx,
+        const Vec3f& light_dir, const Vec3f& eyePos);
+
+private:
+    int width_;
+    int height_;
+    int tile_size_;
+    int tiles_x_;
+    int tiles_y_;
+
+    int batch_size_;
+    int drawn_;
+    // Leading triangles of tris_ kept from earlier batches for the
+    // visibility buffer; they are not counted again.
+    int kept_;
+    std::vector<BinnedTriangle> tris_;
+    std::vector<std::vector<int>> bins_;
+
+    bool deferred_;
+    int lod_w_;
+    int lod_h_;
+    std::vector<int> vis_ids_;
+    std::vector<Vec3f> vis_bary_;
+    // Tiles whose visibility buffer holds pixels still to be shaded.
+    std::vector<char> unresolved_;
+};
+
+int default_thread_count();
+
+#endif
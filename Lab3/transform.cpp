@@ -0,0 +1,51 @@
+#include "transform.h"
+
+VertexTransform::VertexTransform() : m_(Mat4f::identity()), hx_(), hy_(), hz_(), hw_() {
+}
+
+void VertexTransform::set_matrix(Matrix& m) {
+    m_ = m.to_mat4();
+}
+
+// Same summation order as Matrix::operator* on a 4x1 column, so the cached
+// positions match the old per-corner v2m/m2v path bit for bit.
+Vec3f VertexTransform::apply(const Vec3f& v) const {
+    Vec4f p = clip(v);
+    return Vec3f(p[0] / p[3], p[1] / p[3], p[2] / p[3]);
+}
+
+Vec4f VertexTransform::clip(const Vec3f& v) const {
+    return m_ * embed(v);
+}
+
+void VertexTransform::run(const Model& model) {
+    int n = model.nverts();
+    hx_.resize(n);
+    hy_.resize(n);
+    hz_.resize(n);
+    hw_.resize(n);
+
+    // Packed positions are decoded here, on their way into the matrix,
+    // without going through Model::vert.
+    const MeshData& mesh = model.mesh();
+    const PackedPos* qv = mesh.qverts;
+    const QuantBounds& b = mesh.bounds;
+
+    for (int i = 0; i < n; i++) {
+        Vec4f p = clip(qv ? decode_position(qv[i], b) : mesh.verts[i]);
+        hx_[i] = p[0];
+        hy_[i] = p[1];
+        hz_[i] = p[2];
+        hw_[i] = p[3];
+    }
+}
+
+Vec3f VertexTransform::screen(int i) const {
+    return Vec3f(hx_[i] / hw_[i], hy_[i] / hw_[i], hz_[i] / hw_[i]);
+}
+
+Vec4f VertexTransform::clip(int i) const {
+    return Vec4f(hx_[i], hy_[i], hz_[i], hw_[i]);
+}
+
+int VertexTransform::size() const { return (int)hx_.size(); }
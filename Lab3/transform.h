@@ -0,0 +1,32 @@
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+
+// Positions of every model vertex for one frame. The full viewport *
+// projection * model_view product is concatenated once, each vertex is
+// transformed exactly once, and the homogeneous results live in flat
+// x/y/z/w arrays that are reused from frame to frame without reallocating.
+// Screen positions are divided out on demand rather than stored: the
+// divide is cheap next to the 12 bytes per vertex it would take.
+class VertexTransform {
+public:
+    VertexTransform();
+
+    void set_matrix(Matrix& m);
+    void run(const Model& model);
+
+    Vec3f apply(const Vec3f& v) const;
+    Vec4f clip(const Vec3f& v) const;
+    Vec3f screen(int i) const;
+    Vec4f clip(int i) const;
+    int size() const;
+
+private:
+    Mat4f m_;
+    std::vector<float> hx_, hy_, hz_, hw_;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include "vertex_cache.h"
+#include "model.h"
+
+VertexCacheReport measure_vertex_cache(const MeshData& mesh, int cache_size) {
+    VertexCacheReport r = { 0, 0, 0, 0.0, 0.0 };
+
+    // A vertex is in the FIFO if fewer than cache_size misses have happened
+    // since it was loaded.
+    std::vector<long long> loaded(mesh.nverts, -1);
+    std::vector<char> seen(mesh.nverts, 0);
+
+    for (int f = 0; f < mesh.nfaces; f++) {
+        const int* idx = mesh.face_idx + mesh.face_start[f];
+        int n = mesh.face_start[f + 1] - mesh.face_start[f];
+        for (int k = 1; k + 1 < n; k++) {
+            int tri[3] = { idx[0], idx[k], idx[k + 1] };
+            r.triangles++;
+            for (int c = 0; c < 3; c++) {
+                int v = tri[c];
+                if (v < 0 || v >= mesh.nverts) continue;
+                if (!seen[v]) {
+                    seen[v] = 1;
+                    r.verts++;
+                }
+                if (loaded[v] >= 0 && r.misses - loaded[v] < cache_size) continue;
+                loaded[v] = r.misses;
+                r.misses++;
+            }
+        }
+    }
+
+    if (r.triangles) r.acmr = (double)r.misses / r.triangles;
+    if (r.verts) r.atvr = (double)r.misses / r.verts;
+    return r;
+}
+
+// Scoring constants from Forsyth's paper.
+static const float cache_decay_power = 1.5f;
+static const float last_face_score = 0.75f;
+static const float valence_boost_scale = 2.0f;
+static const float valence_boost_power = 0.5f;
+
+static float vertex_score(int cache_pos, int remaining, int cache_size) {
+    if (remaining == 0) return -1.f;
+
+    float score = 0.f;
+    if (cache_pos >= 0) {
+        // The three vertices of the face just emitted get a fixed score, so
+        // the next face does not simply reuse the same edge forever.
+        if (cache_pos < 3) score = last_face_score;
+        else score = std::pow(1.f - (float)(cache_pos - 3) / (cache_size - 3), cache_decay_power);
+    }
+    return score + valence_boost_scale * std::pow((float)remaining, -valence_boost_power);
+}
+
+void optimize_face_order(const MeshData& mesh, const VertexFaceAdjacency& adj,
+    std::vector<int>& order, int cache_size)
+{
+    int nv = mesh.nverts;
+    int nf = mesh.nfaces;
+    cache_size = std::max(cache_size, 4);
+
+    std::vector<int> remaining(nv), cache_pos(nv, -1);
+    std::vector<float> vscore(nv), fscore(nf, 0.f);
+    std::vector<char> emitted(nf, 0);
+    std::vector<int> scored(nf, -1);
+
+    // Scores by cache position and by remaining valence, looked up instead
+    // of calling pow for every vertex touched.
+    static const int max_valence = 32;
+    std::vector<float> pos_score(cache_size + 1), valence_score(max_valence + 1);
+    for (int i = 0; i < cache_size; i++) pos_score[i + 1] = vertex_score(i, 1, cache_size) - vertex_score(-1, 1, cache_size);
+    for (int r = 1; r <= max_valence; r++) valence_score[r] = vertex_score(-1, r, cache_size);
+    auto score = [&](int pos, int r) {
+        if (r == 0) return -1.f;
+        float vs = r <= max_valence ? valence_score[r] : vertex_score(-1, r, cache_size);
+        return vs + pos_score[pos + 1];
+    };
+
+    for (int v = 0; v < nv; v++) {
+        remaining[v] = v < adj.nverts() ? adj.faces(v).size() : 0;
+        vscore[v] = score(-1, remaining[v]);
+    }
+
+    auto face_score = [&](int f) {
+        float s = 0.f;
+        for (int k = mesh.face_start[f]; k < mesh.face_start[f + 1]; k++) {
+            int v = mesh.face_idx[k];
+            if (v >= 0 && v < nv) s += vscore[v];
+        }
+        return s;
+    };
+    for (int f = 0; f < nf; f++) fscore[f] = face_score(f);
+
+    std::vector<int> cache, next_cache;
+    cache.reserve(cache_size + 8);
+    next_cache.reserve(cache_size + 8);
+
+    order.clear();
+    order.reserve(nf);
+
+    int best = -1;
+    int cursor = 0;
+    while ((int)order.size() < nf) {
+        // Nothing in the cache has faces left: take the next face in the
+        // original order. Scanning for the best face overall would make the
+        // pass quadratic.
+        if (best < 0) {
+            while (emitted[cursor]) cursor++;
+            best = cursor;
+        }
+
+        int f = best;
+        emitted[f] = 1;
+        order.push_back(f);
+
+        next_cache.clear();
+        for (int k = mesh.face_start[f]; k < mesh.face_start[f + 1]; k++) {
+            int v = mesh.face_idx[k];
+            if (v < 0 || v >= nv) continue;
+            if (std::find(next_cache.begin(), next_cache.end(), v) != next_cache.end()) continue;
+            next_cache.push_back(v);
+            remaining[v]--;
+        }
+        for (int v : cache) {
+            if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) next_cache.push_back(v);
+        }
+
+        // Positions past cache_size have just been evicted.
+        for (int i = 0; i < (int)next_cache.size(); i++) {
+            int v = next_cache[i];
+            cache_pos[v] = i < cache_size ? i : -1;
+            vscore[v] = score(cache_pos[v], remaining[v]);
+        }
+        if ((int)next_cache.size() > cache_size) next_cache.resize(cache_size);
+        cache.swap(next_cache);
+
+        best = -1;
+        float best_score = -1.f;
+        for (int v : cache) {
+            for (int g : adj.faces(v)) {
+                if (emitted[g] || scored[g] == (int)order.size()) continue;
+                scored[g] = (int)order.size();
+                fscore[g] = face_score(g);
+                if (fscore[g] > best_score) {
+                    best_score = fscore[g];
+                    best = g;
+                }
+            }
+        }
+    }
+}
+
+PostTransformCache::PostTransformCache(int size)
+    : hits(0), misses(0), entries_(), next_(0), width_(0.f), height_(0.f)
+{
+    reset(size, 0.f, 0.f);
+}
+
+void PostTransformCache::reset(int size, float width, float height) {
+    Entry empty;
+    empty.idx = -1;
+    empty.code = 0;
+    entries_.assign(std::max(size, 1), empty);
+    next_ = 0;
+    width_ = width;
+    height_ = height;
+    hits = 0;
+    misses = 0;
+}
+
+const PostTransformCache::Entry& PostTransformCache::fetch(int idx, const Model& m, const VertexTransform& xform) {
+    for (const Entry& e : entries_) {
+        if (e.idx == idx) {
+            hits++;
+            return e;
+        }
+    }
+
+    misses++;
+    Entry& e = entries_[next_];
+    next_ = (next_ + 1) % (int)entries_.size();
+
+    Vec3f world = m.vert(idx);
+    Vec4f p = xform.clip(world);
+    e.idx = idx;
+    e.v.pos = p;
+    e.v.screen = Vec3f(p[0] / p[3], p[1] / p[3], p[2] / p[3]);
+    e.v.world = world;
+    e.v.norm = m.normal(idx);
+    e.code = clip_outcode(p, width_, height_);
+    return e;
+}
@@ -0,0 +1,63 @@
+#ifndef __VERTEX_CACHE_H__
+#define __VERTEX_CACHE_H__
+
+#include <vector>
+#include "geometry.h"
+#include "mesh_cache.h"
+#include "mesh_adjacency.h"
+#include "clipper.h"
+#include "transform.h"
+
+class Model;
+
+static const int vertex_cache_size = 32;
+
+// How well a face order reuses transformed vertices, simulated on a FIFO of
+// cache_size entries over the fanned triangles. ACMR is misses per triangle
+// (0.5 is the ideal for a large regular mesh, 3 the worst); ATVR is misses
+// per referenced vertex (1 is ideal).
+struct VertexCacheReport {
+    long long triangles;
+    long long misses;
+    int verts;
+    double acmr;
+    double atvr;
+};
+
+VertexCacheReport measure_vertex_cache(const MeshData& mesh, int cache_size = vertex_cache_size);
+
+// Face order after Forsyth's linear-speed vertex cache optimization: faces
+// are emitted greedily by the scores of their vertices, which favour
+// vertices recently used (LRU position) and vertices with few faces left.
+// Polygons are scored as a whole, so their fans stay together.
+void optimize_face_order(const MeshData& mesh, const VertexFaceAdjacency& adj,
+    std::vector<int>& order, int cache_size = vertex_cache_size);
+
+// Vertex stage fed by index: transformed vertices are looked up in a small
+// FIFO keyed by vertex index and only transformed on a miss, like the
+// post-transform cache of a GPU. Positions are bit-identical to
+// VertexTransform::run.
+class PostTransformCache {
+public:
+    struct Entry {
+        int idx;
+        unsigned code;
+        ClipVertex v;
+    };
+
+    explicit PostTransformCache(int size = vertex_cache_size);
+
+    void reset(int size, float width, float height);
+    const Entry& fetch(int idx, const Model& m, const VertexTransform& xform);
+
+    long long hits;
+    long long misses;
+
+private:
+    std::vector<Entry> entries_;
+    int next_;
+    float width_;
+    float height_;
+};
+
+#endif